@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "protocols/common/epoch_arena.hpp"
+#include "utils/random.hpp"
+
+/*
+  Space amplification of EpochArena: one live version per row, as the
+  masters of the protocols. The rows are loaded in order, then updated
+  uniformly at random: an update allocates the new version and releases
+  the one it replaces.
+
+  A chunk goes back to the free list only once all its objects are dead,
+  so it is held until its last version is replaced. Prints the chunks held
+  over the chunks the live versions need, after every round of updates
+  (one update per row on average).
+
+  usage: arena_space_bench [rows (default: 1000000)] [version size (64)]
+                           [rounds (20)]
+*/
+
+void *chunk_allocate(size_t size, size_t align) {
+  return aligned_alloc(align, size);
+}
+
+void chunk_deallocate(void *ptr) { free(ptr); }
+
+int main(int argc, char **argv) {
+  uint64_t num_rows = 1 < argc ? strtoull(argv[1], nullptr, 10) : 1000000;
+  uint64_t size = 2 < argc ? strtoull(argv[2], nullptr, 10) : 64;
+  uint64_t rounds = 3 < argc ? strtoull(argv[3], nullptr, 10) : 20;
+
+  EpochArena arena(&chunk_allocate, &chunk_deallocate);
+  std::vector<void *> rows(num_rows);
+  for (void *&row : rows) row = arena.allocate(size);
+
+  uint64_t per_chunk = (EpochArena::CHUNK_SIZE - EpochArena::HEADER_SIZE) /
+                       ((size + 15) & ~15ULL);
+  double needed = static_cast<double>(num_rows) / per_chunk;
+  Xoshiro256PlusPlus rnd(1);
+  printf("rounds, chunks, amplification\n");
+  for (uint64_t round = 0; round <= rounds; round++) {
+    printf("%lu, %lu, %.2f\n", round, arena.num_chunks(),
+           arena.num_chunks() / needed);
+    fflush(stdout);
+    for (uint64_t i = 0; i < num_rows; i++) {
+      void *&row = rows[rnd() % num_rows];
+      void *version = arena.allocate(size);
+      EpochArena::deallocate(row);
+      row = version;
+    }
+  }
+}
@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "protocols/ycsb_common/rendezvous_barrier.hpp"
+#include "utils/numa.hpp"
+#include "utils/tsc.hpp"
+
+/*
+  Cost of one RendezvousBarrier::wait() for 2, 4, 8, ... threads.
+
+  usage: barrier_bench [max threads (default: all cpus)] [rounds]
+*/
+
+uint64_t run(int num_threads, uint64_t rounds) {
+  RendezvousBarrier rend(num_threads);
+  std::vector<uint64_t> cycles(num_threads);
+  std::vector<std::thread> threads;
+  for (int worker = 0; worker < num_threads; worker++) {
+    threads.emplace_back([&, worker] {
+      Numa numa(gettid(), worker);
+      // warm up, and start together
+      rend.wait(RendezvousBarrierVariable::BarrierType::BeforeExp, worker);
+      uint64_t start = rdtscp();
+      for (uint64_t r = 0; r < rounds; r++) {
+        rend.wait(RendezvousBarrierVariable::BarrierType::Exp, worker);
+      }
+      cycles[worker] = rdtscp() - start;
+    });
+  }
+  for (auto& th : threads) th.join();
+  return *std::max_element(cycles.begin(), cycles.end()) / rounds;
+}
+
+int main(int argc, char** argv) {
+  int max_threads = std::min<int>(std::thread::hardware_concurrency(),
+                                  LOGICAL_CORE_SIZE);
+  if (1 < argc) max_threads = std::min(max_threads, atoi(argv[1]));
+  uint64_t rounds = 2 < argc ? strtoull(argv[2], nullptr, 10) : 100000;
+
+  printf("threads, cycles/barrier\n");
+  for (int num_threads = 2; num_threads <= max_threads; num_threads *= 2) {
+    printf("%d, %lu\n", num_threads, run(num_threads, rounds));
+    fflush(stdout);
+  }
+}
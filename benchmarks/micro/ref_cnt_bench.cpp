@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "protocols/common/sharded_counter.hpp"
+#include "protocols/ycsb_common/rendezvous_barrier.hpp"
+#include "utils/numa.hpp"
+#include "utils/perf.hpp"
+#include "utils/tsc.hpp"
+
+/*
+  Reference count of one hot row read by all the threads, as in the epochs
+  of Cheetah:
+  - shared: one counter, incremented in read phase and decremented in
+    execution phase, where the reader that brings it to 0 is the last one
+  - sharded: a ShardedCounter incremented on the shard of the node of the
+    reader in read phase, and combined once after the execution phase
+
+  Prints the cycles and the node accesses and misses (the Perf leader and
+  member) per read, for 2, 4, 8, ... threads.
+
+  usage: ref_cnt_bench [max threads (default: all cpus)] [epochs]
+                       [reads per thread and epoch]
+*/
+
+enum class Scheme { Shared, Sharded };
+
+struct Result {
+  uint64_t cycles_ = 0;  // of the slowest thread
+  uint64_t node_accesses_ = 0;
+  uint64_t node_misses_ = 0;
+};
+
+Result run(Scheme scheme, int num_threads, uint64_t epochs, uint64_t reads) {
+  using BarrierType = RendezvousBarrierVariable::BarrierType;
+  RendezvousBarrier rend(num_threads);
+  alignas(64) uint64_t shared = 0;
+  ShardedCounter sharded;
+  std::vector<Result> results(num_threads);
+  std::vector<std::thread> threads;
+  for (int worker = 0; worker < num_threads; worker++) {
+    threads.emplace_back([&, worker] {
+      Numa numa(gettid(), worker);
+      unsigned int shard = ShardedCounter::shard_of_node(numa.node_);
+      Perf perf(worker, gettid());
+      Perf::Output perf_start, perf_end;
+      rend.wait(BarrierType::BeforeExp, worker);
+
+      perf.perf_read(perf_start);
+      uint64_t start = rdtscp();
+      for (uint64_t e = 0; e < epochs; e++) {
+        // read phase
+        for (uint64_t r = 0; r < reads; r++) {
+          if (scheme == Scheme::Shared) {
+            __atomic_fetch_add(&shared, 1, __ATOMIC_SEQ_CST);
+          } else {
+            sharded.increment(shard);
+          }
+        }
+        rend.wait(BarrierType::InitPhase, worker);
+
+        // execution phase
+        if (scheme == Scheme::Shared) {
+          for (uint64_t r = 0; r < reads; r++) {
+            __atomic_sub_fetch(&shared, 1, __ATOMIC_SEQ_CST);
+          }
+        }
+        rend.wait(BarrierType::ExecPhase, worker);
+
+        // after the execution phase: the last reader is known
+        if (scheme == Scheme::Sharded && worker == 0) {
+          if (sharded.sum() != num_threads * reads) abort();
+          sharded.reset();
+        }
+        rend.wait(BarrierType::NewEpoc, worker);
+      }
+      results[worker].cycles_ = rdtscp() - start;
+      perf.perf_read(perf_end);
+      results[worker].node_accesses_ = perf_end.leader_ - perf_start.leader_;
+      results[worker].node_misses_ = perf_end.member_ - perf_start.member_;
+    });
+  }
+  for (auto& th : threads) th.join();
+
+  Result total;
+  for (const Result& result : results) {
+    total.cycles_ = std::max(total.cycles_, result.cycles_);
+    total.node_accesses_ += result.node_accesses_;
+    total.node_misses_ += result.node_misses_;
+  }
+  return total;
+}
+
+int main(int argc, char** argv) {
+  int max_threads = std::min<int>(std::thread::hardware_concurrency(),
+                                  LOGICAL_CORE_SIZE);
+  if (1 < argc) max_threads = std::min(max_threads, atoi(argv[1]));
+  uint64_t epochs = 2 < argc ? strtoull(argv[2], nullptr, 10) : 1000;
+  uint64_t reads = 3 < argc ? strtoull(argv[3], nullptr, 10) : 1000;
+
+  printf("scheme, threads, cycles/read, node accesses/read, "
+         "node misses/read\n");
+  for (int num_threads = 2; num_threads <= max_threads; num_threads *= 2) {
+    for (Scheme scheme : {Scheme::Shared, Scheme::Sharded}) {
+      Result result = run(scheme, num_threads, epochs, reads);
+      double num_reads = static_cast<double>(num_threads * epochs * reads);
+      printf("%s, %d, %.1f, %.3f, %.3f\n",
+             scheme == Scheme::Shared ? "shared" : "sharded", num_threads,
+             result.cycles_ / static_cast<double>(epochs * reads),
+             result.node_accesses_ / num_reads,
+             result.node_misses_ / num_reads);
+      fflush(stdout);
+    }
+  }
+}
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "benchmarks/ycsb/include/record_layout.hpp"
+#include "benchmarks/ycsb/include/tx_utils.hpp"
+#include "indexes/index.hpp"
+#include "protocols/common/memory_allocator.hpp"
+#include "protocols/serval/include/value.hpp"
+#include "protocols/serval/ycsb/initializer.hpp"
+#include "protocols/ycsb_common/definitions.hpp"
+#include "utils/perf.hpp"
+#include "utils/random.hpp"
+#include "utils/tsc.hpp"
+
+/*
+  Cache misses of one row read of Serval with the Value layout of the build
+  (VALUE_SLAB=1: key-ordered slab and compacted rows, 0: one allocation per
+  row). A read is the chain index -> Value -> final state -> Version ->
+  record, as in the execution phase.
+
+  Build with -DVALUE_SLAB=0 and 1 and compare the LLC read accesses and
+  misses per read (the Perf leader and member).
+
+  usage: value_layout_bench [records (default: 10000000)] [reads]
+*/
+
+volatile mrcu_epoch_type active_epoch = 1;
+volatile std::uint64_t globalepoch = 1;
+volatile bool recovering = false;
+
+int main(int argc, char** argv) {
+  using Index = DefaultIndex<Value>;
+  using Allocator = NumaLocalAllocator;
+
+  uint64_t num_records = 1 < argc ? strtoull(argv[1], nullptr, 10) : 10000000;
+  uint64_t num_reads = 2 < argc ? strtoull(argv[2], nullptr, 10) : 10000000;
+
+  get_mutable_config().set_num_records(num_records);
+  Initializer<Index, Allocator>::load_all_tables<Record>(1);  // on cpu 0
+
+  Xoshiro256PlusPlus rnd(1);
+  std::vector<uint64_t> keys(num_reads);
+  for (auto& key : keys) key = rnd() % num_records;
+
+  Perf perf(0, gettid(), PERF_TYPE_HW_CACHE,
+            PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16),
+            PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+  Perf::Output perf_start, perf_end;
+
+  Index& idx = Index::get_index();
+  uint64_t sum = 0;
+  perf.perf_read(perf_start);
+  uint64_t start = rdtscp();
+  for (uint64_t key : keys) {
+    Value* val;
+    if (idx.find(get_id<Record>(), key, val) != Index::Result::OK) abort();
+    Version* version = val->latest_state().final_state();
+    sum += *static_cast<unsigned char*>(version->rec);
+  }
+  uint64_t cycles = rdtscp() - start;
+  perf.perf_read(perf_end);
+  asm volatile("" : : "r"(sum));  // keep the reads
+
+  printf("VALUE_SLAB, sizeof(Value), cycles/read, LLC accesses/read, "
+         "LLC misses/read\n");
+  printf("%d, %zu, %.1f, %.2f, %.2f\n", VALUE_SLAB, sizeof(Value),
+         static_cast<double>(cycles) / num_reads,
+         static_cast<double>(perf_end.leader_ - perf_start.leader_) / num_reads,
+         static_cast<double>(perf_end.member_ - perf_start.member_) /
+             num_reads);
+}
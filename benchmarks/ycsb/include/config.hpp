@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <cstdio>
 #include <stdexcept>
+#include <string>
 
 class Workload {
     friend class Config;
@@ -70,6 +71,40 @@ class Config {
     void set_num_threads(size_t n) { num_threads = n; }
     size_t get_num_threads() const { return num_threads; }
 
+    // empty: no snapshot
+    void set_snapshot_path(const std::string &path) { snapshot_path = path; }
+    const std::string &get_snapshot_path() const { return snapshot_path; }
+
+    // the command log of COMMAND_LOG builds
+    void set_log_path(const std::string &path) { log_path = path; }
+    const std::string &get_log_path() const { return log_path; }
+
+    // empty: a normal run. Otherwise, the command log to replay
+    void set_recovery_log_path(const std::string &path) {
+        recovery_log_path = path;
+    }
+    const std::string &get_recovery_log_path() const {
+        return recovery_log_path;
+    }
+    bool is_recovery() const { return !recovery_log_path.empty(); }
+
+    // key=value arguments given after the positional ones
+    void set_option(const std::string &option) {
+        size_t eq = option.find('=');
+        std::string key = option.substr(0, eq);
+        if (eq == std::string::npos) {
+            throw std::runtime_error("option must be key=value: " + option);
+        } else if (key == "snapshot") {
+            set_snapshot_path(option.substr(eq + 1));
+        } else if (key == "log") {
+            set_log_path(option.substr(eq + 1));
+        } else if (key == "recover") {
+            set_recovery_log_path(option.substr(eq + 1));
+        } else {
+            throw std::runtime_error("unknown option: " + key);
+        }
+    }
+
     void enable_random_abort() { does_random_abort = true; }
     bool get_random_abort_flag() const { return does_random_abort; }
 
@@ -116,6 +151,9 @@ class Config {
     uint64_t reps_per_txn;
     bool does_random_abort = false;
     std::string protocol_;
+    std::string snapshot_path;
+    std::string log_path = "command.log";
+    std::string recovery_log_path;
 };
 
 inline Config &get_mutable_config() {
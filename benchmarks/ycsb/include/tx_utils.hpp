@@ -5,7 +5,9 @@
 #include <string>      // TODO
 
 #include "benchmarks/ycsb/include/config.hpp"
+#include "indexes/array_index.hpp"
 #include "protocols/ycsb_common/definitions.hpp"
+#include "utils/numa.hpp"
 #include "utils/utils.hpp"
 
 enum Status {
@@ -62,6 +64,7 @@ struct Stat {
     Node,
     Create,
     Delete,
+    LoadTime,
     TotalTime,
     InitializationTime,
     ExecutionTime,
@@ -70,6 +73,11 @@ struct Stat {
     WaitInInitialization,
     WaitInExecution,
     WaitInGC,
+    WaitForLog,
+    MaterializedArrays,
+    StolenTransactions,
+    Suspensions,
+    ArenaChunks,
     PerfLeader,
     PerfMember,
     Size
@@ -80,6 +88,7 @@ struct Stat {
       "Node",
       "Create",
       "Delete",
+      "LoadTime",
       "TotalTime",
       "InitializationTime",
       "ExecutionTime",
@@ -88,6 +97,11 @@ struct Stat {
       "WaitInInitialization",
       "WaitInExecution",
       "WaitInGC",
+      "WaitForLog",
+      "MaterializedArrays",
+      "StolenTransactions",
+      "Suspensions",
+      "ArenaChunks",
       "PerfLeader",
       "PerfMember",
   };
@@ -95,10 +109,14 @@ struct Stat {
   std::vector<std::string> compile_params_ = {
       std::to_string(PAYLOAD_SIZE),
       std::to_string(MAX_SLOTS_OF_PER_CORE_BUFFER),
-      std::to_string(NUM_TXS_IN_ONE_EPOCH), std::to_string(CLOCKS_PER_US)};
+      std::to_string(NUM_TXS_IN_ONE_EPOCH), std::to_string(CLOCKS_PER_US),
+      std::to_string(INLINE_VERSION_SLOTS), std::to_string(PIPELINED_EPOCHS),
+      std::to_string(MAX_CORES), std::to_string(ARRAY_INDEX),
+      std::to_string(VALUE_SLAB), std::to_string(COMMAND_LOG)};
   std::vector<std::string> compile_params_name = {
       "PAYLOAD_SIZE", "MAX_SLOTS_OF_PER_CORE_BUFFER", "NUM_TXS_IN_ONE_EPOCH",
-      "CLOCKS_PER_US"};
+      "CLOCKS_PER_US", "INLINE_VERSION_SLOTS", "PIPELINED_EPOCHS",
+      "MAX_CORES", "ARRAY_INDEX", "VALUE_SLAB", "COMMAND_LOG"};
   std::vector<std::string> get_runtime_params() {
     const Config &c = get_config();
     return {c.get_protocol(),
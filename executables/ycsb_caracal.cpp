@@ -1,6 +1,8 @@
 #include <unistd.h>
 
 #include <bitset>
+#include <cstring>
+#include <memory>
 #include <string>
 #include <thread>
 #include <vector>
@@ -8,7 +10,7 @@
 #include "benchmarks/ycsb/include/config.hpp"
 #include "benchmarks/ycsb/include/tx_runner.hpp"
 #include "benchmarks/ycsb/include/tx_utils.hpp"
-#include "indexes/masstree.hpp"
+#include "indexes/index.hpp"
 #include "protocols/caracal/include/caracal.hpp"
 #include "protocols/caracal/include/major_gc.hpp"
 #include "protocols/caracal/include/operation_set.hpp"
@@ -17,8 +19,14 @@
 #include "protocols/caracal/ycsb/initializer.hpp"
 #include "protocols/caracal/ycsb/transaction.hpp"
 // #include "protocols/common/timestamp_manager.hpp"
+#include "protocols/ycsb_common/command_log.hpp"
 #include "protocols/ycsb_common/definitions.hpp"
+#include "protocols/ycsb_common/recovery.hpp"
 #include "protocols/ycsb_common/rendezvous_barrier.hpp"
+#include "protocols/ycsb_common/resolve_rows.hpp"
+#include "protocols/ycsb_common/serial_id_layout.hpp"
+#include "protocols/ycsb_common/suspended_transactions.hpp"
+#include "protocols/ycsb_common/work_stealing.hpp"
 #include "utils/logger.hpp"
 #include "utils/numa.hpp"
 #include "utils/perf.hpp"
@@ -29,61 +37,99 @@ volatile mrcu_epoch_type active_epoch = 1;
 volatile std::uint64_t globalepoch = 1;
 volatile bool recovering = false;
 
-template <typename Protocol>
+template <typename Protocol, typename Layout>
 void do_initialization_phase(uint64_t worker_id, uint64_t head_in_the_epoch,
-                             Protocol &caracal,
+                             Protocol &caracal, const Layout &layout,
                              std::vector<OperationSet> &txs) {
-  for (uint64_t i = 0; i < NUM_TXS_IN_ONE_EPOCH_IN_ONE_CORE; i++) {
-    caracal.serial_id_ = (i * 64) + worker_id;  // round-robin assignment
-    std::vector<Operation *> &w_set_ =
-        txs[head_in_the_epoch + (i * 64) + worker_id]
-            .w_set_;  // round-robin assignment
+  for (uint64_t i = 0; i < layout.txs_per_core(); i++) {
+    // round-robin assignment
+    caracal.serial_id_ = layout.round_robin(worker_id, i);
+    OperationSet &tx = txs[head_in_the_epoch + caracal.serial_id_];
+    std::vector<Operation *> &w_set_ = tx.w_set_;
+    resolve_rows<DefaultIndex<Value>>(get_id<Record>(), tx.rw_set_);
     for (size_t j = 0; j < w_set_.size(); j++) {
       caracal.append_pending_version(get_id<Record>(), w_set_[j]->index_,
-                                     w_set_[j]->pending_);
+                                     w_set_[j]->val_, w_set_[j]->pending_);
     }
     caracal.terminate_transaction();
   }
   caracal.finalize_batch_append_optimized();
 }
 
+using Continuation = SuspendedTransactions<Version>::Continuation;
+
+// runs the operations of the transaction from c.pos_ on. returns false if a
+// read has to wait for a PENDING version; c is then where to resume from
+template <typename Protocol>
+bool execute_operations(Protocol &caracal, std::vector<Operation *> &rw_set,
+                        Continuation &c) {
+  for (; c.pos_ < rw_set.size(); c.pos_++) {
+    Operation *ope = rw_set[c.pos_];
+    if (ope->ope_ == Operation::Ope::Read) {
+      if (!c.visible_) {
+        c.visible_ = caracal.search_visible_version(ope->val_);
+      }
+      if (!caracal.try_execute_read(c.visible_)) return false;
+      c.visible_ = nullptr;
+    } else if (ope->ope_ == Operation::Ope::Update) {
+      if (ope->pending_) {  // TODO: txθ: w(1)...w(1)
+        caracal.write(get_id<Record>(), ope->pending_, ope->value_);
+      }
+    }
+  }
+  return true;
+}
+
 template <typename Protocol>
 void do_execution_phase(uint64_t worker_id, uint64_t head_in_the_epoch,
-                        Protocol &caracal, std::vector<OperationSet> &txs) {
-  for (uint64_t i = 0; i < NUM_TXS_IN_ONE_EPOCH_IN_ONE_CORE; i++) {
-    assert(i < txs.size());
-    caracal.serial_id_ = (i * 64) + worker_id;  // round-robin assignment
-    uint64_t global_txid = head_in_the_epoch + caracal.serial_id_;
-    std::vector<Operation *> &rw_set = txs[global_txid].rw_set_;
-    for (size_t j = 0; j < rw_set.size(); j++) {
-      if (rw_set[j]->ope_ == Operation::Ope::Read) {
-        caracal.read(get_id<Record>(), rw_set[j]->index_);
-      } else if (rw_set[j]->ope_ == Operation::Ope::Update) {
-        if (rw_set[j]->pending_) {  // TODO: txθ: w(1)...w(1)
-          caracal.write(get_id<Record>(), rw_set[j]->pending_);
-        }
+                        Protocol &caracal, std::vector<OperationSet> &txs,
+                        WorkStealingQueues &queues,
+                        SuspendedTransactions<Version> &suspended, Stat &stat) {
+  Continuation c;
+  uint64_t serial_id;
+  bool stolen;
+  for (;;) {
+    if (suspended.pop_ready(c)) {
+      // resume first: later transactions may be waiting for this one
+    } else if (queues.next(worker_id, caracal.epoch_, serial_id, stolen)) {
+      // own round-robin transactions first, then the ones of other workers
+      if (stolen) stat.increment(Stat::MeasureType::StolenTransactions);
+      c = {serial_id, 0, nullptr};
+    } else if (suspended.empty()) {
+      break;
+    } else {
+      // every remaining transaction of this worker waits for other cores
+      uint64_t start = rdtscp();
+      while (!suspended.pop_ready(c)) {
+        asm volatile("pause" : : : "memory");  // equivalent to "rep; nop"
       }
+      stat.add(Stat::MeasureType::WaitInExecution, rdtscp() - start);
+    }
+
+    caracal.serial_id_ = c.serial_id_;
+    assert(head_in_the_epoch + c.serial_id_ < txs.size());
+    std::vector<Operation *> &rw_set =
+        txs[head_in_the_epoch + c.serial_id_].rw_set_;
+    if (!execute_operations(caracal, rw_set, c)) {
+      stat.increment(Stat::MeasureType::Suspensions);
+      suspended.suspend(c);
     }
   }
 }
 
 void rendezvous_barrier_to_start(RendezvousBarrierVariable::BarrierType type,
                                  RendezvousBarrier &rend, uint32_t worker_id) {
-  if (worker_id == 63) {
-    // do parent work
-    rend.wait_all_children_and_send_start(type);
-  } else {
-    // do children work
-    rend.send_ready_and_wait_start(type);
-  }
+  rend.wait(type, worker_id);
 }
 
-template <typename Protocol>
-void run_tx(RendezvousBarrier &rend, [[maybe_unused]] ThreadLocalData &t_data,
-            uint32_t worker_id, RowBufferController &rrc,
-            std::vector<OperationSet> &txs) {
+template <typename Protocol, typename Layout>
+void run_tx(RendezvousBarrier &rend, WorkStealingQueues &queues,
+            [[maybe_unused]] ThreadLocalData &t_data, uint32_t worker_id,
+            const Layout &layout, RowBufferController &rrc,
+            std::vector<OperationSet> &txs,
+            CommandLog<OperationSet> *log) {
   uint64_t init_total = 0, exec_total = 0, sync1_total = 0, sync2_total = 0;
-  uint64_t init_start, init_end, exec_start, exec_end, sync1_start, sync2_start;
+  uint64_t init_start, init_end, exec_start, exec_end, sync1_start;
 
   [[maybe_unused]] Config &c = get_mutable_config();
 
@@ -100,6 +146,7 @@ void run_tx(RendezvousBarrier &rend, [[maybe_unused]] ThreadLocalData &t_data,
 
   MajorGC gc;
   Protocol caracal(numa.cpu_, worker_id, rrc, t_data.stat, gc);
+  SuspendedTransactions<Version> suspended(layout.txs_per_epoch());
 
   rendezvous_barrier_to_start(RendezvousBarrierVariable::BarrierType::Exp, rend,
                               worker_id);
@@ -108,32 +155,52 @@ void run_tx(RendezvousBarrier &rend, [[maybe_unused]] ThreadLocalData &t_data,
 
   // perf.perf_read(perf_start);
 
+  // NUM_EPOCH, or the epochs of the log when recovering
+  uint64_t num_epochs = txs.size() / layout.txs_per_epoch();
   uint64_t epoch = 1;
-  while (epoch <= NUM_EPOCH) {
+  while (epoch <= num_epochs) {
     caracal.epoch_ = epoch;
 
-    uint64_t head_in_the_epoch = (epoch - 1) * NUM_TXS_IN_ONE_EPOCH;
+    uint64_t head_in_the_epoch = (epoch - 1) * layout.txs_per_epoch();
 
     init_start = rdtscp();
-    do_initialization_phase(worker_id, head_in_the_epoch, caracal, txs);
+    do_initialization_phase(worker_id, head_in_the_epoch, caracal, layout, txs);
 
     init_end = rdtscp();
     init_total = init_total + (init_end - init_start);
 
+    queues.refill(worker_id, epoch);
+
+    if (log) {
+      // the batch of the epoch must be durable before it executes
+      uint64_t log_start = rdtscp();
+      log->wait_durable(epoch);
+      t_data.stat.add(Stat::MeasureType::WaitForLog, rdtscp() - log_start);
+    }
+
     sync1_start = rdtscp();
     rendezvous_barrier_to_start(
         RendezvousBarrierVariable::BarrierType::ExecPhase, rend, worker_id);
     sync1_total = sync1_total + (rdtscp() - sync1_start);
 
+    if (log && worker_id == 0) {
+      log->begin_execution(epoch);  // the batch of epoch + 1 arrives
+    }
+
     exec_start = rdtscp();
-    do_execution_phase(worker_id, head_in_the_epoch, caracal, txs);
+    do_execution_phase(worker_id, head_in_the_epoch, caracal, txs, queues,
+                       suspended, t_data.stat);
     exec_end = rdtscp();
     exec_total = exec_total + (exec_end - exec_start);
 
-    sync2_start = rdtscp();
+#if !PIPELINED_EPOCHS
+    // otherwise, go on with the initialization phase of the next epoch
+    // while the other cores are still executing this one
+    uint64_t sync2_start = rdtscp();
     rendezvous_barrier_to_start(RendezvousBarrierVariable::BarrierType::NewEpoc,
                                 rend, worker_id);
     sync2_total = sync2_total + (rdtscp() - sync2_start);
+#endif
 
     epoch++;  // new epoch start
 
@@ -146,6 +213,9 @@ void run_tx(RendezvousBarrier &rend, [[maybe_unused]] ThreadLocalData &t_data,
   t_data.stat.record(Stat::MeasureType::TotalTime, exp_end - exp_start);
   t_data.stat.record(Stat::MeasureType::InitializationTime, init_total);
   t_data.stat.record(Stat::MeasureType::ExecutionTime, exec_total);
+  // space of the arena: see EpochArena
+  t_data.stat.record(Stat::MeasureType::ArenaChunks,
+                     caracal.arena_.num_chunks());
 
   t_data.stat.record(Stat::MeasureType::Sync1Time, sync1_total);
   t_data.stat.record(Stat::MeasureType::Sync2Time, sync2_total);
@@ -156,7 +226,7 @@ void run_tx(RendezvousBarrier &rend, [[maybe_unused]] ThreadLocalData &t_data,
 }
 
 void print_database() {
-  using Index = MasstreeIndexes<Value>;
+  using Index = DefaultIndex<Value>;
   [[maybe_unused]] Config &c = get_mutable_config();
   for (uint64_t key = 0; key < c.get_num_records(); key++) {
     Index &idx = Index::get_index();
@@ -166,9 +236,10 @@ void print_database() {
     if (res == Index::Result::NOT_FOUND) return;
 
     std::cout << key << ": ";
-    for (auto [id, version] : val->global_array_.ids_slots_) {
-      assert(version->status == Version::VersionStatus::STABLE);
-      std::cout << id << ", ";
+    auto &ids_slots = val->global_array_.ids_slots_;
+    for (uint32_t i = 0; i < ids_slots.size(); i++) {
+      assert(ids_slots.value_at(i)->status == Version::VersionStatus::STABLE);
+      std::cout << ids_slots.id_at(i) << ", ";
     }
     std::cout << std::endl;
   }
@@ -185,11 +256,12 @@ void print_transactions(std::vector<OperationSet> &txs) {
 }
 
 int main(int argc, const char *argv[]) {
-  if (argc != 9) {
+  if (argc < 9) {
     printf(
         "seconds protocol workload_type(A,B,C,F) num_records "
         "num_threads skew "
-        "reps_per_txn exp_id\n");
+        "reps_per_txn exp_id [txs_per_core] [snapshot=path] [log=path] "
+        "[recover=log]\n");
     exit(1);
   }
 
@@ -201,6 +273,11 @@ int main(int argc, const char *argv[]) {
   double skew = std::stod(argv[6]);
   int reps = std::stoi(argv[7], nullptr, 10);
   [[maybe_unused]] int exp_id = std::stoi(argv[8], nullptr, 10);
+  int arg = 9;
+  uint64_t txs_per_core = default_txs_per_core(num_threads);
+  if (arg < argc && !strchr(argv[arg], '=')) {
+    txs_per_core = std::stoul(argv[arg++], nullptr, 10);
+  }
 
   assert(seconds > 0);
 
@@ -211,15 +288,20 @@ int main(int argc, const char *argv[]) {
   c.set_num_threads(num_threads);
   c.set_contention(skew);
   c.set_reps_per_txn(reps);
+  for (; arg < argc; arg++) {
+    c.set_option(argv[arg]);  // key=value
+  }
 
   printf("Loading all tables with %lu record(s) each with %u bytes\n",
          num_records, PAYLOAD_SIZE);
 
-  using Index = MasstreeIndexes<Value>;
-  using Protocol = Caracal<Index>;
+  using Index = DefaultIndex<Value>;
+  using Allocator = NumaLocalAllocator;
 
-  Initializer<Index>::load_all_tables<Record>();  // make database
-  printf("Loaded\n");
+  uint64_t load_start = rdtscp();
+  Initializer<Index, Allocator>::load_all_tables<Record>(num_threads);
+  uint64_t load_time = rdtscp() - load_start;
+  printf("Loaded in %lu ms\n", load_time / CLOCKS_PER_MS);
 
   std::vector<std::thread> threads;
   threads.reserve(num_threads);
@@ -227,27 +309,76 @@ int main(int argc, const char *argv[]) {
   std::vector<ThreadLocalData> t_data(num_threads);
 
   RowBufferController rrc;
-  RendezvousBarrier rend(num_threads - 1);
+  RendezvousBarrier rend(num_threads);
+
+  bool recovered = true;  // or no recovery
+  with_serial_id_layout(num_threads, txs_per_core, [&](const auto &layout) {
+    using Layout = std::decay_t<decltype(layout)>;
+    using Protocol = Caracal<Index, Allocator>;
+
+    WorkStealingQueues queues(layout.num_cores(), layout.txs_per_core());
+
+    std::vector<OperationSet> txs;
+    if (c.is_recovery()) {
+      // replay the epochs of the log instead of new transactions
+      uint64_t read_start = rdtscp();
+      uint64_t num_epochs = CommandLog<OperationSet>::read(
+          c.get_recovery_log_path(), layout.txs_per_epoch(), txs);
+      printf("Read %lu epoch(s) of the command log in %lu ms\n", num_epochs,
+             (rdtscp() - read_start) / CLOCKS_PER_MS);
+      if (num_epochs == 0) {
+        printf("Nothing to replay\n");
+        exit(1);
+      }
+    } else {
+      txs = std::vector<OperationSet>(layout.txs_per_epoch() * NUM_EPOCH);
+    }
 
-  std::vector<OperationSet> txs(NUM_ALL_TXS);
-  for (size_t i = 0; i < txs[0].rw_set_.size(); i++) {
-    std::cout << txs[0].rw_set_[i]->index_ << std::endl;
-  }
+    // joined after the workers, once every batch is durable
+    std::unique_ptr<CommandLog<OperationSet>> log;
+#if COMMAND_LOG
+    if (!c.is_recovery()) {
+      log = std::make_unique<CommandLog<OperationSet>>(
+          c.get_log_path(), txs, layout.txs_per_epoch(), NUM_EPOCH);
+    }
+#endif
+    for (size_t i = 0; i < txs[0].rw_set_.size(); i++) {
+      std::cout << txs[0].rw_set_[i]->index_ << std::endl;
+    }
 
-  for (int i = 0; i < num_threads; i++) {
-    threads.emplace_back(run_tx<Protocol>, std::ref(rend), std::ref(t_data[i]),
-                         i, std::ref(rrc), std::ref(txs));
-  }
-  for (int i = 0; i < num_threads; i++) {
-    threads[i].join();
-  }
+    uint64_t run_start = rdtscp();
+    for (int i = 0; i < num_threads; i++) {
+      threads.emplace_back(run_tx<Protocol, Layout>, std::ref(rend),
+                           std::ref(queues), std::ref(t_data[i]), i,
+                           std::cref(layout), std::ref(rrc), std::ref(txs),
+                           log.get());
+    }
+    for (int i = 0; i < num_threads; i++) {
+      threads[i].join();
+    }
+    if (c.is_recovery()) {
+      uint64_t now = rdtscp();
+      printf("Recovered in %lu ms (replay of %lu transactions: %lu ms)\n",
+             (now - load_start) / CLOCKS_PER_MS, txs.size(),
+             (now - run_start) / CLOCKS_PER_MS);
+    }
 
-  // print_database();
-  // print_transactions(txs);
+    recovered = store_or_check_hash(
+        c, COMMAND_LOG, txs.size() / layout.txs_per_epoch(), sizeof(Record),
+        [](uint64_t key) {
+          return Initializer<Index, Allocator>::committed_record<Record>(key);
+        });
+
+    // print_database();
+    // print_transactions(txs);
+  });
 
   Stat stat;
   std::string filepath = stat.prepare_result_file();
   for (uint64_t i = 0; i < t_data.size(); i++) {
+    t_data[i].stat.record(Stat::MeasureType::LoadTime, load_time);
     t_data[i].stat.log(filepath);
   };
+
+  return recovered ? 0 : 1;
 }
@@ -1,6 +1,8 @@
 #include <unistd.h>
 
 #include <bitset>
+#include <cstring>
+#include <memory>
 #include <string>
 #include <thread>
 #include <vector>
@@ -8,14 +10,20 @@
 #include "benchmarks/ycsb/include/config.hpp"
 #include "benchmarks/ycsb/include/tx_runner.hpp"
 #include "benchmarks/ycsb/include/tx_utils.hpp"
-#include "indexes/masstree.hpp"
+#include "indexes/index.hpp"
 #include "protocols/cheetah/include/cheetah.hpp"
 #include "protocols/cheetah/include/operation_set.hpp"
 #include "protocols/cheetah/include/value.hpp"
 #include "protocols/cheetah/ycsb/initializer.hpp"
 #include "protocols/cheetah/ycsb/transaction.hpp"
+#include "protocols/ycsb_common/command_log.hpp"
 #include "protocols/ycsb_common/definitions.hpp"
+#include "protocols/ycsb_common/recovery.hpp"
 #include "protocols/ycsb_common/rendezvous_barrier.hpp"
+#include "protocols/ycsb_common/resolve_rows.hpp"
+#include "protocols/ycsb_common/serial_id_layout.hpp"
+#include "protocols/ycsb_common/suspended_transactions.hpp"
+#include "protocols/ycsb_common/work_stealing.hpp"
 #include "utils/logger.hpp"
 #include "utils/numa.hpp"
 #include "utils/perf.hpp"
@@ -30,16 +38,18 @@ template <typename Protocol>
 void do_write_phase(uint64_t worker_id, uint64_t head_in_the_epoch,
                     Protocol &serval, std::vector<OperationSet> &txs) {
   serval.core_ = worker_id;  // sequential assignment
-  for (uint64_t i = 0; i < NUM_TXS_IN_ONE_EPOCH_IN_ONE_CORE; i++) {
+  serval.collect_retired_rows();  // of the previous epoch
+  for (uint64_t i = 0; i < serval.layout_.txs_per_core(); i++) {
     // ============ sequential assignment ============
-    serval.serial_id_ = (worker_id * 64) + i;  // sequential assignment
-    std::vector<Operation *> &w_set =
-        txs[head_in_the_epoch + (worker_id * 64) + i]
-            .w_set_;  // sequential assignment
+    serval.serial_id_ = serval.layout_.sequential(worker_id, i);
+    OperationSet &tx = txs[head_in_the_epoch + serval.serial_id_];
+    std::vector<Operation *> &w_set = tx.w_set_;
     // ============ sequential assignment ============
+    // the rows of the reads too, for the read phase
+    resolve_rows<DefaultIndex<Value>>(get_id<Record>(), tx.rw_set_);
     for (size_t j = 0; j < w_set.size(); j++) {
       serval.update_write_bitmaps(get_id<Record>(), w_set[j]->index_,
-                                  w_set[j]->w_bitmap_);
+                                  w_set[j]->val_, w_set[j]->w_bitmap_);
       assert(w_set[j]->w_bitmap_);
     }
     serval.terminate_transaction();
@@ -51,17 +61,16 @@ template <typename Protocol>
 void do_read_phase(uint64_t worker_id, uint64_t head_in_the_epoch,
                    Protocol &serval, std::vector<OperationSet> &txs) {
   serval.core_ = worker_id;  // sequential assignment
-  for (uint64_t i = 0; i < NUM_TXS_IN_ONE_EPOCH_IN_ONE_CORE; i++) {
+  for (uint64_t i = 0; i < serval.layout_.txs_per_core(); i++) {
     // ============ sequential assignment ============
-    serval.serial_id_ = (worker_id * 64) + i;  // sequential assignment
+    serval.serial_id_ = serval.layout_.sequential(worker_id, i);
     std::vector<Operation *> &rw_set =
-        txs[head_in_the_epoch + (worker_id * 64) + i]
-            .rw_set_;  // sequential assignment
+        txs[head_in_the_epoch + serval.serial_id_].rw_set_;
     // ============ sequential assignment ============
     for (size_t j = 0; j < rw_set.size(); j++) {
       if (rw_set[j]->ope_ == Operation::Ope::Read) {
         serval.append_pending_version(get_id<Record>(), rw_set[j]->index_,
-                                      rw_set[j]->pending_,
+                                      rw_set[j]->val_, rw_set[j]->pending_,
                                       rw_set[j]->w_bitmap_);
         assert(rw_set[j]->pending_);
         assert(rw_set[j]->w_bitmap_);
@@ -71,45 +80,79 @@ void do_read_phase(uint64_t worker_id, uint64_t head_in_the_epoch,
   }
 }
 
+using Continuation = SuspendedTransactions<Version>::Continuation;
+
+// runs the operations of the transaction from c.pos_ on. returns false if a
+// read has to wait for a PENDING version; c is then where to resume from
+template <typename Protocol>
+bool execute_operations(Protocol &serval, std::vector<Operation *> &rw_set,
+                        Continuation &c) {
+  for (; c.pos_ < rw_set.size(); c.pos_++) {
+    Operation *ope = rw_set[c.pos_];
+    if (ope->ope_ == Operation::Ope::Read) {
+      assert(ope->pending_);
+      if (!serval.try_read(get_id<Record>(), ope->index_, ope->pending_,
+                         ope->w_bitmap_)) {
+        c.visible_ = ope->pending_;
+        return false;
+      }
+      c.visible_ = nullptr;
+    } else if (ope->ope_ == Operation::Ope::Update) {
+      serval.write(get_id<Record>(), ope->w_bitmap_, ope->value_);
+    }
+  }
+  return true;
+}
+
 template <typename Protocol>
 void do_execution_phase(uint64_t worker_id, uint64_t head_in_the_epoch,
-                        Protocol &serval, std::vector<OperationSet> &txs) {
-  for (uint64_t i = 0; i < NUM_TXS_IN_ONE_EPOCH_IN_ONE_CORE; i++) {
-    assert(i < txs.size());
-    // ============ round-robin assignment ============
-    serval.serial_id_ = (i * 64) + worker_id;  // round-robin assignment
-    serval.core_ = i;                          // round-robin assignment
-    std::vector<Operation *> &rw_set =
-        txs[head_in_the_epoch + (i * 64) + worker_id]
-            .rw_set_;  // round-robin assignment
-    // ============ round-robin assignment ============
-    for (size_t j = 0; j < rw_set.size(); j++) {
-      if (rw_set[j]->ope_ == Operation::Ope::Read) {
-        assert(rw_set[j]->pending_);
-        serval.read(get_id<Record>(), rw_set[j]->index_, rw_set[j]->pending_,
-                    rw_set[j]->w_bitmap_);
-      } else if (rw_set[j]->ope_ == Operation::Ope::Update) {
-        serval.write(get_id<Record>(), rw_set[j]->w_bitmap_);
+                        Protocol &serval, std::vector<OperationSet> &txs,
+                        WorkStealingQueues &queues,
+                        SuspendedTransactions<Version> &suspended, Stat &stat) {
+  Continuation c;
+  uint64_t serial_id;
+  bool stolen;
+  for (;;) {
+    if (suspended.pop_ready(c)) {
+      // resume first: later transactions may be waiting for this one
+    } else if (queues.next(worker_id, serval.epoch_, serial_id, stolen)) {
+      // own round-robin transactions first, then the ones of other workers
+      if (stolen) stat.increment(Stat::MeasureType::StolenTransactions);
+      c = {serial_id, 0, nullptr};
+    } else if (suspended.empty()) {
+      break;
+    } else {
+      // every remaining transaction of this worker waits for other cores
+      uint64_t start = rdtscp();
+      while (!suspended.pop_ready(c)) {
+        asm volatile("pause" : : : "memory");  // equivalent to "rep; nop"
       }
+      stat.add(Stat::MeasureType::WaitInExecution, rdtscp() - start);
+    }
+
+    serval.serial_id_ = c.serial_id_;
+    serval.core_ = serval.layout_.core(serval.serial_id_);
+    assert(head_in_the_epoch + c.serial_id_ < txs.size());
+    std::vector<Operation *> &rw_set =
+        txs[head_in_the_epoch + c.serial_id_].rw_set_;
+    if (!execute_operations(serval, rw_set, c)) {
+      stat.increment(Stat::MeasureType::Suspensions);
+      suspended.suspend(c);
     }
   }
 }
 
 void rendezvous_barrier_to_start(RendezvousBarrierVariable::BarrierType type,
                                  RendezvousBarrier &rend, uint32_t worker_id) {
-  if (worker_id == 63) {
-    // do parent work
-    rend.wait_all_children_and_send_start(type);
-  } else {
-    // do children work
-    rend.send_ready_and_wait_start(type);
-  }
+  rend.wait(type, worker_id);
 }
 
-template <typename Protocol>
-void run_tx(RendezvousBarrier &rend, [[maybe_unused]] ThreadLocalData &t_data,
-            uint32_t worker_id,
-            [[maybe_unused]] std::vector<OperationSet> &txs) {
+template <typename Protocol, typename Layout>
+void run_tx(RendezvousBarrier &rend, WorkStealingQueues &queues,
+            [[maybe_unused]] ThreadLocalData &t_data, uint32_t worker_id,
+            const Layout &layout,
+            [[maybe_unused]] std::vector<OperationSet> &txs,
+            CommandLog<OperationSet> *log) {
   uint64_t init_total = 0, exec_total = 0;
   uint64_t init_start, init_end, exec_start, exec_end;
   [[maybe_unused]] Config &c = get_mutable_config();
@@ -121,7 +164,8 @@ void run_tx(RendezvousBarrier &rend, [[maybe_unused]] ThreadLocalData &t_data,
   t_data.stat.record(Stat::MeasureType::Core, numa.cpu_);
   t_data.stat.record(Stat::MeasureType::Node, numa.node_);
 
-  Protocol serval(numa.cpu_, worker_id, t_data.stat);
+  Protocol serval(numa.cpu_, worker_id, layout, t_data.stat);
+  SuspendedTransactions<Version> suspended(layout.txs_per_epoch());
 
   // Perf perf(worker_id, tid);
   // Perf::Output perf_start, perf_end;
@@ -131,12 +175,14 @@ void run_tx(RendezvousBarrier &rend, [[maybe_unused]] ThreadLocalData &t_data,
   uint64_t exp_start = rdtscp();
   // perf.perf_read(perf_start);
 
+  // NUM_EPOCH, or the epochs of the log when recovering
+  uint64_t num_epochs = txs.size() / layout.txs_per_epoch();
   uint64_t epoch = 1;
-  while (epoch <= NUM_EPOCH) {
+  while (epoch <= num_epochs) {
     serval.epoch_ = epoch;
 
     [[maybe_unused]] uint64_t head_in_the_epoch =
-        (epoch - 1) * NUM_TXS_IN_ONE_EPOCH;
+        (epoch - 1) * layout.txs_per_epoch();
 
     init_start = rdtscp();
     do_write_phase(worker_id, head_in_the_epoch, serval, txs);
@@ -148,12 +194,27 @@ void run_tx(RendezvousBarrier &rend, [[maybe_unused]] ThreadLocalData &t_data,
 
     init_end = rdtscp();
     init_total = init_total + (init_end - init_start);
+
+    queues.refill(worker_id, epoch);
+
+    if (log) {
+      // the batch of the epoch must be durable before it executes
+      uint64_t log_start = rdtscp();
+      log->wait_durable(epoch);
+      t_data.stat.add(Stat::MeasureType::WaitForLog, rdtscp() - log_start);
+    }
+
     rendezvous_barrier_to_start(
         RendezvousBarrierVariable::BarrierType::ExecPhase, rend, worker_id);
 
+    if (log && worker_id == 0) {
+      log->begin_execution(epoch);  // the batch of epoch + 1 arrives
+    }
+
     exec_start = rdtscp();
 
-    do_execution_phase(worker_id, head_in_the_epoch, serval, txs);
+    do_execution_phase(worker_id, head_in_the_epoch, serval, txs, queues,
+                       suspended, t_data.stat);
     exec_end = rdtscp();
     exec_total = exec_total + (exec_end - exec_start);
 
@@ -168,6 +229,9 @@ void run_tx(RendezvousBarrier &rend, [[maybe_unused]] ThreadLocalData &t_data,
   t_data.stat.record(Stat::MeasureType::TotalTime, exp_end - exp_start);
   t_data.stat.record(Stat::MeasureType::InitializationTime, init_total);
   t_data.stat.record(Stat::MeasureType::ExecutionTime, exec_total);
+  // space of the arena: see EpochArena
+  t_data.stat.record(Stat::MeasureType::ArenaChunks,
+                     serval.arena_.num_chunks());
 
   // t_data.stat.record(Stat::MeasureType::PerfLeader,
   //                    perf_end.leader_ - perf_start.leader_);
@@ -224,11 +288,12 @@ bool has_write(OperationSet &tx, uint64_t key) {
 // }
 
 int main(int argc, const char *argv[]) {
-  if (argc != 9) {
+  if (argc < 9) {
     printf(
         "seconds protocol workload_type(A,B,C,F) num_records "
         "num_threads skew "
-        "reps_per_txn exp_id\n");
+        "reps_per_txn exp_id [txs_per_core] [snapshot=path] [log=path] "
+        "[recover=log]\n");
     exit(1);
   }
 
@@ -240,6 +305,11 @@ int main(int argc, const char *argv[]) {
   double skew = std::stod(argv[6]);
   int reps = std::stoi(argv[7], nullptr, 10);
   [[maybe_unused]] int exp_id = std::stoi(argv[8], nullptr, 10);
+  int arg = 9;
+  uint64_t txs_per_core = default_txs_per_core(num_threads);
+  if (arg < argc && !strchr(argv[arg], '=')) {
+    txs_per_core = std::stoul(argv[arg++], nullptr, 10);
+  }
 
   assert(seconds > 0);
 
@@ -250,39 +320,92 @@ int main(int argc, const char *argv[]) {
   c.set_num_threads(num_threads);
   c.set_contention(skew);
   c.set_reps_per_txn(reps);
+  for (; arg < argc; arg++) {
+    c.set_option(argv[arg]);  // key=value
+  }
 
   printf("Loading all tables with %lu record(s) each with %u bytes\n",
          num_records, PAYLOAD_SIZE);
 
-  using Index = MasstreeIndexes<Value>;
-  using Protocol = Serval<Index>;
+  using Index = DefaultIndex<Value>;
+  using Allocator = NumaLocalAllocator;
 
-  Initializer<Index>::load_all_tables<Record>();
-  printf("Loaded\n");
+  uint64_t load_start = rdtscp();
+  Initializer<Index, Allocator>::load_all_tables<Record>(num_threads);
+  uint64_t load_time = rdtscp() - load_start;
+  printf("Loaded in %lu ms\n", load_time / CLOCKS_PER_MS);
 
   std::vector<std::thread> threads;
   threads.reserve(num_threads);
 
   std::vector<ThreadLocalData> t_data(num_threads);
 
-  RendezvousBarrier rend(num_threads - 1);
+  RendezvousBarrier rend(num_threads);
+
+  bool recovered = true;  // or no recovery
+  with_serial_id_layout(num_threads, txs_per_core, [&](const auto &layout) {
+    using Layout = std::decay_t<decltype(layout)>;
+    using Protocol = Serval<Index, Allocator, Layout>;
+
+    WorkStealingQueues queues(layout.num_cores(), layout.txs_per_core());
+
+    std::vector<OperationSet> txs;
+    if (c.is_recovery()) {
+      // replay the epochs of the log instead of new transactions
+      uint64_t read_start = rdtscp();
+      uint64_t num_epochs = CommandLog<OperationSet>::read(
+          c.get_recovery_log_path(), layout.txs_per_epoch(), txs);
+      printf("Read %lu epoch(s) of the command log in %lu ms\n", num_epochs,
+             (rdtscp() - read_start) / CLOCKS_PER_MS);
+      if (num_epochs == 0) {
+        printf("Nothing to replay\n");
+        exit(1);
+      }
+    } else {
+      txs = std::vector<OperationSet>(layout.txs_per_epoch() * NUM_EPOCH);
+    }
 
-  std::vector<OperationSet> txs(NUM_ALL_TXS);
-  std::cout << "start..." << std::endl;
+    // joined after the workers, once every batch is durable
+    std::unique_ptr<CommandLog<OperationSet>> log;
+#if COMMAND_LOG
+    if (!c.is_recovery()) {
+      log = std::make_unique<CommandLog<OperationSet>>(
+          c.get_log_path(), txs, layout.txs_per_epoch(), NUM_EPOCH);
+    }
+#endif
+    std::cout << "start..." << std::endl;
+
+    uint64_t run_start = rdtscp();
+    for (int i = 0; i < num_threads; i++) {
+      threads.emplace_back(run_tx<Protocol, Layout>, std::ref(rend),
+                           std::ref(queues), std::ref(t_data[i]), i,
+                           std::cref(layout), std::ref(txs), log.get());
+    }
+    for (int i = 0; i < num_threads; i++) {
+      threads[i].join();
+    }
+    if (c.is_recovery()) {
+      uint64_t now = rdtscp();
+      printf("Recovered in %lu ms (replay of %lu transactions: %lu ms)\n",
+             (now - load_start) / CLOCKS_PER_MS, txs.size(),
+             (now - run_start) / CLOCKS_PER_MS);
+    }
 
-  for (int i = 0; i < num_threads; i++) {
-    threads.emplace_back(run_tx<Protocol>, std::ref(rend), std::ref(t_data[i]),
-                         i, std::ref(txs));
-  }
-  for (int i = 0; i < num_threads; i++) {
-    threads[i].join();
-  }
+    recovered = store_or_check_hash(
+        c, COMMAND_LOG, txs.size() / layout.txs_per_epoch(), sizeof(Record),
+        [](uint64_t key) {
+          return Initializer<Index, Allocator>::committed_record<Record>(key);
+        });
+  });
 
   // print_database(txs);
 
   Stat stat;
   std::string filepath = stat.prepare_result_file();
   for (size_t i = 0; i < t_data.size(); i++) {
+    t_data[i].stat.record(Stat::MeasureType::LoadTime, load_time);
     t_data[i].stat.log(filepath);
   };
-}
\ No newline at end of file
+
+  return recovered ? 0 : 1;
+}
@@ -1,6 +1,8 @@
 #include <unistd.h>
 
 #include <bitset>
+#include <cstring>
+#include <memory>
 #include <string>
 #include <thread>
 #include <vector>
@@ -8,7 +10,7 @@
 #include "benchmarks/ycsb/include/config.hpp"
 #include "benchmarks/ycsb/include/tx_runner.hpp"
 #include "benchmarks/ycsb/include/tx_utils.hpp"
-#include "indexes/masstree.hpp"
+#include "indexes/index.hpp"
 #include "protocols/serval/include/major_gc.hpp"
 #include "protocols/serval/include/operation_set.hpp"
 #include "protocols/serval/include/row_region.hpp"
@@ -16,8 +18,14 @@
 #include "protocols/serval/include/value.hpp"
 #include "protocols/serval/ycsb/initializer.hpp"
 #include "protocols/serval/ycsb/transaction.hpp"
+#include "protocols/ycsb_common/command_log.hpp"
 #include "protocols/ycsb_common/definitions.hpp"
+#include "protocols/ycsb_common/recovery.hpp"
 #include "protocols/ycsb_common/rendezvous_barrier.hpp"
+#include "protocols/ycsb_common/resolve_rows.hpp"
+#include "protocols/ycsb_common/serial_id_layout.hpp"
+#include "protocols/ycsb_common/suspended_transactions.hpp"
+#include "protocols/ycsb_common/work_stealing.hpp"
 #include "utils/logger.hpp"
 #include "utils/numa.hpp"
 #include "utils/perf.hpp"
@@ -52,62 +60,97 @@ template <typename Protocol>
 void do_initialization_phase(uint64_t worker_id, uint64_t head_in_the_epoch,
                              Protocol &serval, std::vector<OperationSet> &txs) {
   serval.core_ = worker_id;  // sequential assignment
-  for (uint64_t i = 0; i < NUM_TXS_IN_ONE_EPOCH_IN_ONE_CORE; i++) {
+  for (uint64_t i = 0; i < serval.layout_.txs_per_core(); i++) {
     // ============ sequential assignment ============
-    serval.serial_id_ = (worker_id * 64) + i;  // sequential assignment
-    std::vector<Operation *> &w_set =
-        txs[head_in_the_epoch + (worker_id * 64) + i]
-            .w_set_;  // sequential assignment
+    serval.serial_id_ = serval.layout_.sequential(worker_id, i);
+    OperationSet &tx = txs[head_in_the_epoch + serval.serial_id_];
+    std::vector<Operation *> &w_set = tx.w_set_;
     // ============ sequential assignment ============
+    resolve_rows<DefaultIndex<Value>>(get_id<Record>(), tx.rw_set_);
     for (size_t j = 0; j < w_set.size(); j++) {
       serval.append_pending_version(get_id<Record>(), w_set[j]->index_,
-                                    w_set[j]->pending_);
+                                    w_set[j]->val_, w_set[j]->pending_);
     }
     serval.terminate_transaction();
   }
+  serval.release_cold_regions();
+}
+
+using Continuation = SuspendedTransactions<Version>::Continuation;
+
+// runs the operations of the transaction from c.pos_ on. returns false if a
+// read has to wait for a PENDING version; c is then where to resume from
+template <typename Protocol>
+bool execute_operations(Protocol &serval, std::vector<Operation *> &rw_set,
+                        Continuation &c) {
+  for (; c.pos_ < rw_set.size(); c.pos_++) {
+    Operation *ope = rw_set[c.pos_];
+    if (ope->ope_ == Operation::Ope::Read) {
+      if (!c.visible_) {
+        c.visible_ = serval.search_visible_version(ope->val_);
+      }
+      if (!serval.try_execute_read(c.visible_)) return false;
+      c.visible_ = nullptr;
+    } else if (ope->ope_ == Operation::Ope::Update) {
+      if (ope->pending_) {  // TODO: txθ: w(1)...w(1)
+        serval.write(get_id<Record>(), ope->pending_, ope->value_);
+      }
+    }
+  }
+  return true;
 }
 
 template <typename Protocol>
 void do_execution_phase(uint64_t worker_id, uint64_t head_in_the_epoch,
-                        Protocol &serval, std::vector<OperationSet> &txs) {
-  for (uint64_t i = 0; i < NUM_TXS_IN_ONE_EPOCH_IN_ONE_CORE; i++) {
-    assert(i < txs.size());
-    // ============ round-robin assignment ============
-    serval.serial_id_ = (i * 64) + worker_id;  // round-robin assignment
-    serval.core_ = i;                          // round-robin assignment
-    std::vector<Operation *> &rw_set =
-        txs[head_in_the_epoch + (i * 64) + worker_id]
-            .rw_set_;  // round-robin assignment
-    // ============ round-robin assignment ============
-    for (size_t j = 0; j < rw_set.size(); j++) {
-      if (rw_set[j]->ope_ == Operation::Ope::Read) {
-        serval.read(get_id<Record>(), rw_set[j]->index_);
-      } else if (rw_set[j]->ope_ == Operation::Ope::Update) {
-        if (rw_set[j]->pending_) {  // TODO: txθ: w(1)...w(1)
-          serval.write(get_id<Record>(), rw_set[j]->pending_);
-        }
+                        Protocol &serval, std::vector<OperationSet> &txs,
+                        WorkStealingQueues &queues,
+                        SuspendedTransactions<Version> &suspended, Stat &stat) {
+  Continuation c;
+  uint64_t serial_id;
+  bool stolen;
+  for (;;) {
+    if (suspended.pop_ready(c)) {
+      // resume first: later transactions may be waiting for this one
+    } else if (queues.next(worker_id, serval.epoch_, serial_id, stolen)) {
+      // own round-robin transactions first, then the ones of other workers
+      if (stolen) stat.increment(Stat::MeasureType::StolenTransactions);
+      c = {serial_id, 0, nullptr};
+    } else if (suspended.empty()) {
+      break;
+    } else {
+      // every remaining transaction of this worker waits for other cores
+      uint64_t start = rdtscp();
+      while (!suspended.pop_ready(c)) {
+        asm volatile("pause" : : : "memory");  // equivalent to "rep; nop"
       }
+      stat.add(Stat::MeasureType::WaitInExecution, rdtscp() - start);
+    }
+
+    serval.serial_id_ = c.serial_id_;
+    serval.core_ = serval.layout_.core(serval.serial_id_);
+    assert(head_in_the_epoch + c.serial_id_ < txs.size());
+    std::vector<Operation *> &rw_set =
+        txs[head_in_the_epoch + c.serial_id_].rw_set_;
+    if (!execute_operations(serval, rw_set, c)) {
+      stat.increment(Stat::MeasureType::Suspensions);
+      suspended.suspend(c);
     }
   }
 }
 
 void rendezvous_barrier_to_start(RendezvousBarrierVariable::BarrierType type,
                                  RendezvousBarrier &rend, uint32_t worker_id) {
-  if (worker_id == 63) {
-    // do parent work
-    rend.wait_all_children_and_send_start(type);
-  } else {
-    // do children work
-    rend.send_ready_and_wait_start(type);
-  }
+  rend.wait(type, worker_id);
 }
 
-template <typename Protocol>
-void run_tx(RendezvousBarrier &rend, [[maybe_unused]] ThreadLocalData &t_data,
-            uint32_t worker_id, RowRegionController &rrc,
-            [[maybe_unused]] std::vector<OperationSet> &txs) {
+template <typename Protocol, typename Layout>
+void run_tx(RendezvousBarrier &rend, WorkStealingQueues &queues,
+            [[maybe_unused]] ThreadLocalData &t_data, uint32_t worker_id,
+            const Layout &layout, RowRegionController &rrc,
+            [[maybe_unused]] std::vector<OperationSet> &txs,
+            CommandLog<OperationSet> *log) {
   uint64_t init_total = 0, exec_total = 0, sync1_total = 0, sync2_total = 0;
-  uint64_t init_start, init_end, exec_start, exec_end, sync1_start, sync2_start;
+  uint64_t init_start, init_end, exec_start, exec_end, sync1_start;
   [[maybe_unused]] Config &c = get_mutable_config();
 
   // Pre-Initialization Phase
@@ -118,7 +161,8 @@ void run_tx(RendezvousBarrier &rend, [[maybe_unused]] ThreadLocalData &t_data,
   t_data.stat.record(Stat::MeasureType::Node, numa.node_);
 
   MajorGC gc;
-  Protocol serval(numa.cpu_, worker_id, rrc, t_data.stat, gc);
+  Protocol serval(numa.cpu_, worker_id, layout, rrc, t_data.stat, gc);
+  SuspendedTransactions<Version> suspended(layout.txs_per_epoch());
 
   // Perf perf(worker_id, tid);
   // Perf::Output perf_start, perf_end;
@@ -128,12 +172,14 @@ void run_tx(RendezvousBarrier &rend, [[maybe_unused]] ThreadLocalData &t_data,
   uint64_t exp_start = rdtscp();
   // perf.perf_read(perf_start);
 
+  // NUM_EPOCH, or the epochs of the log when recovering
+  uint64_t num_epochs = txs.size() / layout.txs_per_epoch();
   uint64_t epoch = 1;
-  while (epoch <= NUM_EPOCH) {
+  while (epoch <= num_epochs) {
     serval.epoch_ = epoch;
 
     [[maybe_unused]] uint64_t head_in_the_epoch =
-        (epoch - 1) * NUM_TXS_IN_ONE_EPOCH;
+        (epoch - 1) * layout.txs_per_epoch();
 
     init_start = rdtscp();
 
@@ -142,25 +188,43 @@ void run_tx(RendezvousBarrier &rend, [[maybe_unused]] ThreadLocalData &t_data,
     init_end = rdtscp();
     init_total = init_total + (init_end - init_start);
 
+    queues.refill(worker_id, epoch);
+
+    if (log) {
+      // the batch of the epoch must be durable before it executes
+      uint64_t log_start = rdtscp();
+      log->wait_durable(epoch);
+      t_data.stat.add(Stat::MeasureType::WaitForLog, rdtscp() - log_start);
+    }
+
     sync1_start = rdtscp();
     rendezvous_barrier_to_start(
         RendezvousBarrierVariable::BarrierType::ExecPhase, rend, worker_id);
     sync1_total = sync1_total + (rdtscp() - sync1_start);
 
+    if (log && worker_id == 0) {
+      log->begin_execution(epoch);  // the batch of epoch + 1 arrives
+    }
+
     exec_start = rdtscp();
 
-    do_execution_phase(worker_id, head_in_the_epoch, serval, txs);
+    do_execution_phase(worker_id, head_in_the_epoch, serval, txs, queues,
+                       suspended, t_data.stat);
     exec_end = rdtscp();
     exec_total = exec_total + (exec_end - exec_start);
 
-    sync2_start = rdtscp();
+#if !PIPELINED_EPOCHS
+    // otherwise, go on with the initialization phase of the next epoch
+    // while the other cores are still executing this one
+    uint64_t sync2_start = rdtscp();
     rendezvous_barrier_to_start(RendezvousBarrierVariable::BarrierType::NewEpoc,
                                 rend, worker_id);
     sync2_total = sync2_total + (rdtscp() - sync2_start);
+#endif
 
     epoch++;  // new epoch start
 
-    // gc.major_gc(worker_id, epoch, t_data.stat);
+    // gc.major_gc(worker_id, epoch, rrc, t_data.stat);
   }
   // uint64_t exp_end = worker_id == 0 ? rdtscp() : 0;
   uint64_t exp_end = rdtscp();
@@ -169,6 +233,9 @@ void run_tx(RendezvousBarrier &rend, [[maybe_unused]] ThreadLocalData &t_data,
   t_data.stat.record(Stat::MeasureType::TotalTime, exp_end - exp_start);
   t_data.stat.record(Stat::MeasureType::InitializationTime, init_total);
   t_data.stat.record(Stat::MeasureType::ExecutionTime, exec_total);
+  // space of the arena: see EpochArena
+  t_data.stat.record(Stat::MeasureType::ArenaChunks,
+                     serval.arena_.num_chunks());
   t_data.stat.record(Stat::MeasureType::Sync1Time, sync1_total);
   t_data.stat.record(Stat::MeasureType::Sync2Time, sync2_total);
 
@@ -185,8 +252,10 @@ bool has_write(OperationSet &tx, uint64_t key) {
   return false;
 }
 
-void print_database([[maybe_unused]] std::vector<OperationSet> &txs) {
-  using Index = MasstreeIndexes<Value>;
+template <typename Layout>
+void print_database(const Layout &layout,
+                    [[maybe_unused]] std::vector<OperationSet> &txs) {
+  using Index = DefaultIndex<Value>;
   [[maybe_unused]] Config &c = get_mutable_config();
   for (uint64_t key = 0; key < c.get_num_records(); key++) {
     Index &idx = Index::get_index();
@@ -195,11 +264,15 @@ void print_database([[maybe_unused]] std::vector<OperationSet> &txs) {
 
     if (res == Index::Result::NOT_FOUND) return;
 
-    if (0 < val->epoch_) {
+    RowState &state = val->latest_state();
+    if (0 < state.epoch_) {
       [[maybe_unused]] uint64_t head_in_the_epoch =
-          (val->epoch_ - 1) * NUM_TXS_IN_ONE_EPOCH;
+          (state.epoch_ - 1) * layout.txs_per_epoch();
       std::cout << "global_array: ";
-      for (auto [id, version] : val->global_array_.ids_slots_) {
+      auto &ids_slots = state.global_array_.ids_slots_;
+      for (uint32_t i = 0; i < ids_slots.size(); i++) {
+        [[maybe_unused]] int id = ids_slots.id_at(i);
+        [[maybe_unused]] Version *version = ids_slots.value_at(i);
         assert(0 <= id);
         assert(version->status == Version::VersionStatus::STABLE);
         assert(has_write(txs[head_in_the_epoch + id], key));
@@ -207,22 +280,21 @@ void print_database([[maybe_unused]] std::vector<OperationSet> &txs) {
       }
       std::cout << std::endl;
       std::cout << "region: ";
-      if (val->has_dirty_region()) {
-        for (size_t core = 0; core < 64; core++) {
-          if (is_bit_set_at_the_position(val->row_region_->core_bitmap_,
-                                         core)) {
-            PerCoreVersionArray *array = val->row_region_->arrays_[core];
-            assert(array->length() == (int)array->slots_.size());
+      if (state.has_dirty_region()) {
+        for (size_t core = 0; core < layout.num_cores(); core++) {
+          if (state.row_region_->core_bitmap_.test(core)) {
+            PerCoreVersionArray *array = state.row_region_->arrays_[core];
+            assert(array->length() == (int)array->num_slots());
             uint64_t tx_bitmap = array->transaction_bitmap_;
             uint64_t txid = 0;
-            for (size_t i = 0; i < array->slots_.size(); i++) {
+            for (size_t i = 0; i < array->num_slots(); i++) {
               assert(array->slots_[i]->status ==
                      Version::VersionStatus::STABLE);
               while ((tx_bitmap & set_bit_at_the_given_location(txid)) == 0) {
                 txid++;
               }
               tx_bitmap = tx_bitmap & ~set_bit_at_the_given_location(txid);
-              uint64_t serial_id = core * 64 + txid;
+              uint64_t serial_id = layout.serial_id(core, txid);
               std::cout << serial_id << " ";
 
               if (!has_write(txs[head_in_the_epoch + serial_id], key)) {
@@ -247,16 +319,17 @@ void print_database([[maybe_unused]] std::vector<OperationSet> &txs) {
     }
 
     // std::cout << key << ": ";
-    // val->global_array_.print();
+    // state.global_array_.print();
   }
 }
 
 int main(int argc, const char *argv[]) {
-  if (argc != 9) {
+  if (argc < 9) {
     printf(
         "seconds protocol workload_type(A,B,C,F) num_records "
         "num_threads skew "
-        "reps_per_txn exp_id\n");
+        "reps_per_txn exp_id [txs_per_core] [snapshot=path] [log=path] "
+        "[recover=log]\n");
     exit(1);
   }
 
@@ -268,6 +341,11 @@ int main(int argc, const char *argv[]) {
   double skew = std::stod(argv[6]);
   int reps = std::stoi(argv[7], nullptr, 10);
   [[maybe_unused]] int exp_id = std::stoi(argv[8], nullptr, 10);
+  int arg = 9;
+  uint64_t txs_per_core = default_txs_per_core(num_threads);
+  if (arg < argc && !strchr(argv[arg], '=')) {
+    txs_per_core = std::stoul(argv[arg++], nullptr, 10);
+  }
 
   assert(seconds > 0);
 
@@ -278,15 +356,20 @@ int main(int argc, const char *argv[]) {
   c.set_num_threads(num_threads);
   c.set_contention(skew);
   c.set_reps_per_txn(reps);
+  for (; arg < argc; arg++) {
+    c.set_option(argv[arg]);  // key=value
+  }
 
   printf("Loading all tables with %lu record(s) each with %u bytes\n",
          num_records, PAYLOAD_SIZE);
 
-  using Index = MasstreeIndexes<Value>;
-  using Protocol = Serval<Index>;
+  using Index = DefaultIndex<Value>;
+  using Allocator = NumaLocalAllocator;
 
-  Initializer<Index>::load_all_tables<Record>();
-  printf("Loaded\n");
+  uint64_t load_start = rdtscp();
+  Initializer<Index, Allocator>::load_all_tables<Record>(num_threads);
+  uint64_t load_time = rdtscp() - load_start;
+  printf("Loaded in %lu ms\n", load_time / CLOCKS_PER_MS);
 
   std::vector<std::thread> threads;
   threads.reserve(num_threads);
@@ -294,26 +377,75 @@ int main(int argc, const char *argv[]) {
   std::vector<ThreadLocalData> t_data(num_threads);
 
   RowRegionController rrc;
-  RendezvousBarrier rend(num_threads - 1);
+  RendezvousBarrier rend(num_threads);
+
+  bool recovered = true;  // or no recovery
+  with_serial_id_layout(num_threads, txs_per_core, [&](const auto &layout) {
+    using Layout = std::decay_t<decltype(layout)>;
+    using Protocol = Serval<Index, Allocator, Layout>;
+
+    WorkStealingQueues queues(layout.num_cores(), layout.txs_per_core());
+
+    std::vector<OperationSet> txs;
+    if (c.is_recovery()) {
+      // replay the epochs of the log instead of new transactions
+      uint64_t read_start = rdtscp();
+      uint64_t num_epochs = CommandLog<OperationSet>::read(
+          c.get_recovery_log_path(), layout.txs_per_epoch(), txs);
+      printf("Read %lu epoch(s) of the command log in %lu ms\n", num_epochs,
+             (rdtscp() - read_start) / CLOCKS_PER_MS);
+      if (num_epochs == 0) {
+        printf("Nothing to replay\n");
+        exit(1);
+      }
+    } else {
+      txs = std::vector<OperationSet>(layout.txs_per_epoch() * NUM_EPOCH);
+    }
 
-  std::vector<OperationSet> txs(NUM_ALL_TXS);
-  for (size_t i = 0; i < txs[0].rw_set_.size(); i++) {
-    std::cout << txs[0].rw_set_[i]->index_ << std::endl;
-  }
+    // joined after the workers, once every batch is durable
+    std::unique_ptr<CommandLog<OperationSet>> log;
+#if COMMAND_LOG
+    if (!c.is_recovery()) {
+      log = std::make_unique<CommandLog<OperationSet>>(
+          c.get_log_path(), txs, layout.txs_per_epoch(), NUM_EPOCH);
+    }
+#endif
+    for (size_t i = 0; i < txs[0].rw_set_.size(); i++) {
+      std::cout << txs[0].rw_set_[i]->index_ << std::endl;
+    }
 
-  for (int i = 0; i < num_threads; i++) {
-    threads.emplace_back(run_tx<Protocol>, std::ref(rend), std::ref(t_data[i]),
-                         i, std::ref(rrc), std::ref(txs));
-  }
-  for (int i = 0; i < num_threads; i++) {
-    threads[i].join();
-  }
+    uint64_t run_start = rdtscp();
+    for (int i = 0; i < num_threads; i++) {
+      threads.emplace_back(run_tx<Protocol, Layout>, std::ref(rend),
+                           std::ref(queues), std::ref(t_data[i]), i,
+                           std::cref(layout), std::ref(rrc), std::ref(txs),
+                           log.get());
+    }
+    for (int i = 0; i < num_threads; i++) {
+      threads[i].join();
+    }
+    if (c.is_recovery()) {
+      uint64_t now = rdtscp();
+      printf("Recovered in %lu ms (replay of %lu transactions: %lu ms)\n",
+             (now - load_start) / CLOCKS_PER_MS, txs.size(),
+             (now - run_start) / CLOCKS_PER_MS);
+    }
 
-  // print_database(txs);
+    recovered = store_or_check_hash(
+        c, COMMAND_LOG, txs.size() / layout.txs_per_epoch(), sizeof(Record),
+        [](uint64_t key) {
+          return Initializer<Index, Allocator>::committed_record<Record>(key);
+        });
+
+    // print_database(layout, txs);
+  });
 
   Stat stat;
   std::string filepath = stat.prepare_result_file();
   for (size_t i = 0; i < t_data.size(); i++) {
+    t_data[i].stat.record(Stat::MeasureType::LoadTime, load_time);
     t_data[i].stat.log(filepath);
   };
+
+  return recovered ? 0 : 1;
 }
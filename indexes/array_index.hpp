@@ -0,0 +1,174 @@
+#pragma once
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+
+#include "benchmarks/ycsb/include/config.hpp"
+#include "protocols/common/schema.hpp"
+
+// 1: the benchmarks use ArrayIndex instead of Masstree; set by CMake
+#ifndef ARRAY_INDEX
+#define ARRAY_INDEX 0
+#endif
+
+/*
+  Index for dense integer keys 0, 1, ..., num_records - 1.
+
+  The Value* of key k is the k-th slot of a per-table array, so find() is a
+  single load. The arrays are mapped with huge pages when the system has
+  them (MAP_HUGETLB, then transparent huge pages), and sized from
+  get_config().get_num_records() when the first key of a table is
+  inserted. Keys outside the array are simply not found.
+
+  Same interface as MasstreeIndexes for what the protocols use (find,
+  multi_find, insert, remove), so it can be given as their Index.
+*/
+template <typename Value_>
+class ArrayIndex {
+public:
+    using Key = uint64_t;
+    using Value = Value_;
+    struct NodeInfo {};  // no nodes: nothing to validate
+    struct LeafNode {};
+
+    enum Result {
+        OK = 0,
+        NOT_FOUND,
+        BAD_INSERT,
+        NOT_INSERTED,
+        NOT_DELETED,
+        BAD_SCAN,
+    };
+
+    static constexpr size_t MAX_TABLES = 16;
+
+    void create_table(TableID table_id) { get_or_create_table(table_id); }
+
+    Result find(TableID table_id, Key key, Value*& val) {
+        Table* table = get_table(table_id);
+        if (table == nullptr || table->size_ <= key) {
+            val = nullptr;
+            return NOT_FOUND;
+        }
+        val = __atomic_load_n(&table->vals_[key], __ATOMIC_ACQUIRE);
+        return val == nullptr ? NOT_FOUND : OK;
+    }
+
+    // vals[i] is nullptr if keys[i] is not found
+    Result multi_find(TableID table_id, const Key* keys, Value** vals, size_t n) {
+        Table* table = get_table(table_id);
+        Result res = OK;
+        for (size_t i = 0; i < n; i++) {
+            if (table == nullptr || table->size_ <= keys[i]) {
+                vals[i] = nullptr;
+                res = NOT_FOUND;
+                continue;
+            }
+            vals[i] = __atomic_load_n(&table->vals_[keys[i]], __ATOMIC_ACQUIRE);
+            if (vals[i] == nullptr)
+                res = NOT_FOUND;
+            else
+                __builtin_prefetch(vals[i], 1);
+        }
+        return res;
+    }
+
+    Result insert(TableID table_id, Key key, Value* val) {
+        Table* table = get_or_create_table(table_id);
+        if (table->size_ <= key)
+            return NOT_INSERTED;
+        Value* expected = nullptr;
+        bool inserted = __atomic_compare_exchange_n(
+            &table->vals_[key], &expected, val, false, __ATOMIC_RELEASE,
+            __ATOMIC_RELAXED);
+        return inserted ? OK : NOT_INSERTED;
+    }
+
+    Result remove(TableID table_id, Key key) {
+        Table* table = get_table(table_id);
+        if (table == nullptr || table->size_ <= key)
+            return NOT_DELETED;
+        Value* val = __atomic_exchange_n(&table->vals_[key], nullptr, __ATOMIC_ACQ_REL);
+        return val == nullptr ? NOT_DELETED : OK;
+    }
+
+    // Other
+    static ArrayIndex<Value>& get_index() {
+        static ArrayIndex<Value> idx;
+        return idx;
+    }
+
+    ~ArrayIndex() {
+        for (size_t i = 0; i < num_tables_; i++) {
+            munmap(tables_[i].vals_, tables_[i].bytes_);
+        }
+    }
+
+private:
+    struct Table {
+        TableID id_ = 0;
+        Value** vals_ = nullptr;
+        uint64_t size_ = 0;  // number of keys
+        size_t bytes_ = 0;   // mapped
+    };
+
+    // published in order, never removed: lookups do not take the lock
+    Table tables_[MAX_TABLES];
+    size_t num_tables_ = 0;
+    std::mutex mutex_;
+
+    // TableID is the record size, not a dense id, so the (few) tables are
+    // scanned
+    Table* get_table(TableID table_id) {
+        size_t n = __atomic_load_n(&num_tables_, __ATOMIC_ACQUIRE);
+        for (size_t i = 0; i < n; i++) {
+            if (tables_[i].id_ == table_id)
+                return &tables_[i];
+        }
+        return nullptr;
+    }
+
+    Table* get_or_create_table(TableID table_id) {
+        Table* table = get_table(table_id);
+        if (table != nullptr)
+            return table;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        table = get_table(table_id);  // created in the meantime
+        if (table != nullptr)
+            return table;
+        if (num_tables_ == MAX_TABLES)
+            throw std::runtime_error("too many tables for ArrayIndex");
+
+        table = &tables_[num_tables_];
+        table->id_ = table_id;
+        table->size_ = get_config().get_num_records();
+        table->vals_ = map(table->size_, table->bytes_);
+        __atomic_store_n(&num_tables_, num_tables_ + 1, __ATOMIC_RELEASE);
+        return table;
+    }
+
+    // zero-filled array of n pointers
+    static Value** map(uint64_t n, size_t& bytes) {
+        constexpr size_t HUGE_PAGE_SIZE = 2UL << 20;
+        bytes = (std::max<uint64_t>(n, 1) * sizeof(Value*) + HUGE_PAGE_SIZE - 1) &
+                ~(HUGE_PAGE_SIZE - 1);
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p == MAP_FAILED) {
+            // no reserved huge pages: fall back to transparent ones
+            p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+                throw std::bad_alloc();
+            madvise(p, bytes, MADV_HUGEPAGE);
+        }
+        return static_cast<Value**>(p);
+    }
+};
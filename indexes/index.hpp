@@ -0,0 +1,13 @@
+#pragma once
+
+#include "indexes/array_index.hpp"
+#include "indexes/masstree.hpp"
+
+// the index of the benchmarks (ARRAY_INDEX, see array_index.hpp)
+#if ARRAY_INDEX
+template <typename Value>
+using DefaultIndex = ArrayIndex<Value>;
+#else
+template <typename Value>
+using DefaultIndex = MasstreeIndexes<Value>;
+#endif
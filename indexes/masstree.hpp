@@ -27,6 +27,12 @@ public:
         BAD_SCAN,
     };
 
+    // call it before several threads insert into a new table: indexes
+    // itself is not thread-safe
+    void create_table(TableID table_id) {
+        indexes.try_emplace(table_id);
+    }
+
     Result find(TableID table_id, Key key, Value*& val) {
         auto& mt = indexes[table_id];
         mt.thread_init(0);
@@ -38,6 +44,24 @@ public:
             return OK;
     }
 
+    // looks keys[0, n) up at once: the table and the thread are resolved
+    // once, and the row of each hit is prefetched while the next key is
+    // traversed. vals[i] is nullptr if keys[i] is not found
+    Result multi_find(TableID table_id, const Key* keys, Value** vals, size_t n) {
+        auto& mt = indexes[table_id];
+        mt.thread_init(0);
+        Result res = OK;
+        for (size_t i = 0; i < n; i++) {
+            Key key_buf = byte_swap(keys[i]);
+            vals[i] = mt.get_value(reinterpret_cast<char*>(&key_buf), sizeof(Key));
+            if (vals[i] == nullptr)
+                res = NOT_FOUND;
+            else
+                __builtin_prefetch(vals[i], 1);
+        }
+        return res;
+    }
+
     Result find(TableID table_id, Key key, Value*& val, NodeMap& nm) {
         auto& mt = indexes[table_id];
         mt.thread_init(0);
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <set>
 #include <stdexcept>
+#include <utility>
+#include <vector>
 
 #include "indexes/masstree.hpp"
 #include "protocols/caracal/include/major_gc.hpp"
@@ -11,16 +14,19 @@
 #include "protocols/caracal/include/row_buffer.hpp"
 #include "protocols/caracal/include/value.hpp"
 #include "protocols/caracal/include/version.hpp"
+#include "protocols/common/epoch_arena.hpp"
+#include "protocols/common/memory_allocator.hpp"
 
 // #include "protocols/common/timestamp_manager.hpp"
 #include "protocols/common/transaction_id.hpp"
 #include "protocols/ycsb_common/definitions.hpp"  // for delete Record
+#include "protocols/ycsb_common/record_misc.hpp"
 #include "utils/bitmap.hpp"
 #include "utils/logger.hpp"
 #include "utils/tsc.hpp"
 #include "utils/utils.hpp"
 
-template <typename Index>
+template <typename Index, typename Allocator>
 class Caracal {
  public:
   using Key = typename Index::Key;
@@ -32,6 +38,7 @@ class Caracal {
           MajorGC &gc)
       : core_(core_id),
         serial_id_(txid),
+        arena_(EpochArena::get_arena<Allocator>()),
         rrc_(rrc),
         stat_(stat),
         major_gc_(gc) {}
@@ -47,9 +54,13 @@ class Caracal {
   }
 
   void append_pending_version(TableID table_id, Key key, Version *&pending) {
-    assert(0 < epoch_);
-    Index &idx = Index::get_index();
+    append_pending_version(table_id, key, find_value(table_id, key), pending);
+  }
 
+  // val: the row of key, looked up beforehand (see resolve_rows)
+  void append_pending_version(TableID table_id, Key key, Value *val,
+                              Version *&pending) {
+    assert(0 < epoch_);
     tables.insert(table_id);
     std::vector<Key> &w_table = ws.get_table(table_id);
     typename std::vector<Key>::iterator w_iter =
@@ -57,19 +68,6 @@ class Caracal {
 
     // Case of not append occur
     if (w_iter == w_table.end()) {
-      Value *val;
-      typename Index::Result res =
-          idx.find(table_id, key, val);  // find corresponding index in masstree
-
-      if (res == Index::Result::NOT_FOUND) {
-        assert(false);
-        throw std::runtime_error(
-            "masstree NOT_FOUND");  // TODO: この場合、どうするかを考える
-        return;
-      }
-
-      // Got value from masstree
-
       do_append_pending_version(val, pending);
       assert(pending);
 
@@ -84,37 +82,54 @@ class Caracal {
   }
 
   const Rec *read(TableID table_id, Key key) {
-    Index &idx = Index::get_index();
-
-    Value *val;
-    typename Index::Result res =
-        idx.find(table_id, key, val);  // find corresponding index in masstree
+    return wait_stable_and_execute_read(search_visible_version(table_id, key));
+  }
 
-    if (res == Index::Result::NOT_FOUND) {
-      assert(false);
-      throw std::runtime_error(
-          "masstree NOT_FOUND");  // TODO: この場合、どうするかを考える
-      return nullptr;
-    }
+  // the version to read; it may still be PENDING (see try_execute_read)
+  Version *search_visible_version(TableID table_id, Key key) {
+    return search_visible_version(find_value(table_id, key));
+  }
 
+  // val: the row to read, looked up beforehand (see resolve_rows)
+  Version *search_visible_version(Value *val) {
+    assert(val);
+#if PIPELINED_EPOCHS
+    // the initialization phase of the next epoch may be appending to the
+    // array on another core
+    val->global_array_.rwl.lock_shared();
+#endif
     auto [visible_id, visible] =
         val->global_array_.search_visible_version(epoch_, serial_id_);
+#if PIPELINED_EPOCHS
+    val->global_array_.rwl.unlock_shared();
+#endif
     assert(visible);
-    Rec *rec = wait_stable_and_execute_read(visible);
+    return visible;
+  }
 
-    return rec;
+  // nullptr while the visible version is still PENDING: the caller can run
+  // another transaction and retry later instead of spinning
+  const Rec *try_execute_read(Version *visible) {
+    assert(visible);
+    if (__atomic_load_n(&visible->status, __ATOMIC_SEQ_CST) ==
+        Version::VersionStatus::PENDING) {
+      return nullptr;
+    }
+    return execute_read(visible);
   }
 
-  Rec *write(TableID table_id, Version *pending) {
-    return upsert(table_id, pending);
+  // value: of the update (see write_value())
+  Rec *write(TableID table_id, Version *pending, uint64_t value) {
+    return upsert(table_id, pending, value);
   }
 
-  Rec *upsert(TableID table_id, Version *pending) {
+  Rec *upsert(TableID table_id, Version *pending, uint64_t value) {
     const Schema &sch = Schema::get_schema();
     size_t record_size = sch.get_record_size(table_id);
 
-    // Rec *rec = MemoryAllocator::aligned_allocate(record_size);
-    Rec *rec = reinterpret_cast<Rec *>(operator new(record_size));
+    Rec *rec =
+        reinterpret_cast<Rec *>(pending->allocate_record(arena_, record_size));
+    write_value(rec, record_size, value);  // before the version is STABLE
     __atomic_store_n(&pending->rec, rec, __ATOMIC_SEQ_CST);  // write
     __atomic_store_n(&pending->status, Version::VersionStatus::STABLE,
                      __ATOMIC_SEQ_CST);
@@ -133,42 +148,47 @@ class Caracal {
      contend on some rows during batch-append. If this happens, Caracal
      will delay batch-appending the contending row and process other rows
      first.
+
+     The delayed rows are retried in order of expected contention: the
+     number of times their lock was busy, the least contended first.
   */
   void finalize_batch_append_optimized() {
-    while (!appended_core_buffers_.empty()) {
-      auto itr = appended_core_buffers_.begin();
-      while (itr != appended_core_buffers_.end()) {
-        Value *val = itr->first;
-        PerCoreBuffer *buffer = itr->second;
-        uint64_t start = rdtscp();
-        if (!val->global_array_.try_lock()) {
-          itr = std::next(itr);
-          stat_.add(Stat::MeasureType::WaitInInitialization, rdtscp() - start);
-          continue;
-        }
-        val->global_array_.batch_append(buffer, epoch_, stat_);
-        val->global_array_.unlock();
-        itr = appended_core_buffers_.erase(itr);
+    assert(retry_.empty());
+    while (dirty_head_) {
+      PerCoreBuffer *buffer = pop_dirty();
+      if (!try_batch_append(buffer)) retry_.emplace_back(1, buffer);
+    }
+
+    auto more_contended = [](const auto &a, const auto &b) {
+      return a.first > b.first;
+    };
+    std::make_heap(retry_.begin(), retry_.end(), more_contended);
+    while (!retry_.empty()) {
+      std::pop_heap(retry_.begin(), retry_.end(), more_contended);
+      auto &[num_busy, buffer] = retry_.back();
+      if (try_batch_append(buffer)) {
+        retry_.pop_back();
+        continue;
       }
+      num_busy++;
+      std::push_heap(retry_.begin(), retry_.end(), more_contended);
     }
   }
 
   void finalize_batch_append_non_optimized() {
-    while (!appended_core_buffers_.empty()) {
-      auto itr = appended_core_buffers_.begin();
-      Value *val = itr->first;
-      PerCoreBuffer *buffer = itr->second;
+    while (dirty_head_) {
+      PerCoreBuffer *buffer = pop_dirty();
       // bufferに残っているpendingsをバッチアペンドする
-      val->global_array_.lock();
-      val->global_array_.batch_append(buffer, epoch_, stat_);
-      val->global_array_.unlock();
-      appended_core_buffers_.erase(itr);
+      buffer->array_->lock();
+      buffer->array_->batch_append(buffer, epoch_, stat_);
+      buffer->array_->unlock();
     }
   }
 
   uint64_t core_;
   uint64_t serial_id_;
   uint64_t epoch_;
+  EpochArena &arena_;  // versions and records of this core
 
  private:
   WriteSet<Key> ws;  // write set
@@ -182,7 +202,52 @@ class Caracal {
 
   MajorGC &major_gc_;
 
-  std::unordered_map<Value *, PerCoreBuffer *> appended_core_buffers_;
+  // the per-core buffers to batch-append, linked by next_dirty_
+  PerCoreBuffer *dirty_head_ = nullptr;
+
+  // <#times the lock was busy, buffer> (see finalize_batch_append_optimized)
+  std::vector<std::pair<uint32_t, PerCoreBuffer *>> retry_;
+
+  void push_dirty(Value *val, PerCoreBuffer *buffer) {
+    if (buffer->dirty_) return;
+    buffer->dirty_ = true;
+    buffer->array_ = &val->global_array_;
+    buffer->next_dirty_ = dirty_head_;
+    dirty_head_ = buffer;
+  }
+
+  PerCoreBuffer *pop_dirty() {
+    PerCoreBuffer *buffer = dirty_head_;
+    dirty_head_ = buffer->next_dirty_;
+    buffer->next_dirty_ = nullptr;
+    buffer->dirty_ = false;
+    return buffer;
+  }
+
+  bool try_batch_append(PerCoreBuffer *buffer) {
+    uint64_t start = rdtscp();
+    if (!buffer->array_->try_lock()) {
+      stat_.add(Stat::MeasureType::WaitInInitialization, rdtscp() - start);
+      return false;
+    }
+    buffer->array_->batch_append(buffer, epoch_, stat_);
+    buffer->array_->unlock();
+    return true;
+  }
+
+  Value *find_value(TableID table_id, Key key) {
+    Index &idx = Index::get_index();
+    Value *val;
+    typename Index::Result res =
+        idx.find(table_id, key, val);  // find corresponding index in masstree
+
+    if (res == Index::Result::NOT_FOUND) {
+      assert(false);
+      throw std::runtime_error(
+          "masstree NOT_FOUND");  // TODO: この場合、どうするかを考える
+    }
+    return val;
+  }
 
   void do_append_pending_version(Value *val, Version *&pending) {
     assert(!pending);
@@ -208,7 +273,7 @@ class Caracal {
       new_buffer = spare_buffer_;
       spare_buffer_ = nullptr;
     } else {
-      new_buffer = rrc_.fetch_new_buffer();
+      new_buffer = rrc_.fetch_new_buffer(core_);
     }
 
     assert(cur_buffer == nullptr);
@@ -253,7 +318,7 @@ class Caracal {
 
     if (core_buffer->appendable(pending, epoch_, serial_id_)) {
       // not full
-      appended_core_buffers_.insert({val, core_buffer});  // TODO: 高速化
+      push_dirty(val, core_buffer);
     } else {
       // per core buffer is full and append to global array
       uint64_t start = rdtscp();
@@ -267,7 +332,7 @@ class Caracal {
   }
 
   Version *create_pending_version([[maybe_unused]] GlobalVersionArray &array) {
-    Version *version = new Version;
+    Version *version = arena_.create<Version>();
     assert(version);
     version->rec = nullptr;  // TODO
     version->deleted = false;
@@ -1,14 +1,17 @@
 #pragma once
 
-#include <algorithm> // for find()
+#include <algorithm> // for find(), sort()
 #include <unistd.h>  // for gettid()
 
 #include "protocols/caracal/include/readwriteset.hpp"
 #include "protocols/caracal/include/version.hpp"
+#include "protocols/common/epoch_arena.hpp"
 #include "protocols/common/readwritelock.hpp"
+#include "protocols/common/region_pool.hpp"
 #include "protocols/ycsb_common/definitions.hpp"
 #include "utils/bitmap.hpp"
 #include "utils/numa.hpp"
+#include "utils/small_sorted_array.hpp"
 
 /*
   global id:
@@ -28,10 +31,22 @@ static uint64_t convert_to_serial_id_with_epoch(uint64_t epoch,
 
 static uint64_t get_epoch(uint64_t global_id) { return global_id >> 32; }
 
+class GlobalVersionArray;
+
 class PerCoreBuffer { // Caracal's per-core buffer
   public:
     // use pair data structure
-    std::vector<std::pair<uint64_t, Version *>> ids_slots_; // ascending order
+    std::vector<std::pair<uint64_t, Version *>> ids_slots_; // append order
+    bool sorted_ = true; // ids_slots_ is in ascending order
+
+    /*
+    the dirty list of the core that owns the buffer: the buffers it has to
+    batch-append at the end of its initialization phase. dirty_ avoids
+    linking a buffer twice. only touched by the owner core.
+    */
+    bool dirty_ = false;
+    GlobalVersionArray *array_ = nullptr; // of the row of the buffer
+    PerCoreBuffer *next_dirty_ = nullptr;
 
     bool appendable(Version *version, uint64_t epoch, uint64_t serial_id) {
         assert(version);
@@ -40,28 +55,43 @@ class PerCoreBuffer { // Caracal's per-core buffer
 
         // append to per-core buffer
         assert(ids_slots_.size() < MAX_SLOTS_OF_PER_CORE_BUFFER);
-        // Find the position to append the version
-        auto it = std::upper_bound(ids_slots_.begin(), ids_slots_.end(),
-                                   std::make_pair(global_id, nullptr),
-                                   [](const auto &pair, const auto &new_pair) {
-                                       return pair.first < new_pair.first;
-                                   }); // ascending order
-        // Append to the corresponding position
-        ids_slots_.insert(it, std::make_pair(global_id, version));
+        // a core appends in serial order: the buffer is only sorted by
+        // sorted_slots() if an append comes out of order
+        if (!ids_slots_.empty() && global_id < ids_slots_.back().first)
+            sorted_ = false;
+        ids_slots_.emplace_back(global_id, version);
 
         if (ids_slots_.size() < MAX_SLOTS_OF_PER_CORE_BUFFER)
             return true; // the buffer is not full
         return false;    // the buffer is full
     }
 
-    void clear_slots() { ids_slots_.clear(); }
+    // ascending order
+    const std::vector<std::pair<uint64_t, Version *>> &sorted_slots() {
+        if (!sorted_) {
+            std::sort(ids_slots_.begin(), ids_slots_.end(),
+                      [](const auto &a, const auto &b) {
+                          return a.first < b.first;
+                      });
+            sorted_ = true;
+        }
+        return ids_slots_;
+    }
+
+    void clear_slots() {
+        ids_slots_.clear();
+        sorted_ = true;
+    }
 };
 
 class GlobalVersionArray {
   public:
+    static constexpr uint32_t INLINE_SLOTS = 8;
+
     RWLock rwl;
 
-    std::vector<std::pair<uint64_t, Version *>> ids_slots_; // ascending order
+    SmallSortedArray<uint64_t, Version *, INLINE_SLOTS>
+        ids_slots_; // ascending order
 
     void lock() { rwl.lock(); }
 
@@ -71,25 +101,14 @@ class GlobalVersionArray {
 
     // for debug
     bool is_exist(uint64_t epoch, uint64_t serial_id) {
-        uint64_t global_id = convert_to_serial_id_with_epoch(epoch, serial_id);
-
-        // Use std::find with a custom comparator
-        auto it = std::find_if(
-            ids_slots_.begin(), ids_slots_.end(),
-            [global_id](const auto &pair) { return pair.first == global_id; });
-        return it != ids_slots_.end();
+        return ids_slots_.contains(
+            convert_to_serial_id_with_epoch(epoch, serial_id));
     }
 
     // これに失敗すると、GCにバグがある可能性が高い
     bool is_exist_visible_version(uint64_t global_id) {
         if (global_id != 0) {
-            auto result = std::find_if(ids_slots_.begin(), ids_slots_.end(),
-                                       [global_id](const auto &pair) {
-                                           return pair.first < global_id;
-                                       });
-            if (result == ids_slots_.end()) {
-                return false;
-            }
+            return 0 < ids_slots_.rank(global_id);
         }
         return true;
     }
@@ -113,27 +132,23 @@ class GlobalVersionArray {
         assert(is_exist_visible_version(global_id));
         // =========== for debug ===========
 
-        // Find the first element whose id is greater than the given serial_id
-        auto it = std::upper_bound(
-            ids_slots_.begin(), ids_slots_.end(), global_id,
-            [](uint64_t id, const auto &pair) { return id <= pair.first; });
-
-        assert(it != ids_slots_.begin());
-        // Move the iterator back to the previous element
-        --it;
-        assert(is_visible(global_id, it->first));
+        // the last element whose id is less than global_id
+        uint32_t pos = ids_slots_.rank(global_id);
+        assert(0 < pos);
+        uint64_t visible_id = ids_slots_.id_at(pos - 1);
+        assert(is_visible(global_id, visible_id));
 
         // Return the tx_id and the corresponding Version* object
-        return {it->first, it->second};
+        return {visible_id, ids_slots_.value_at(pos - 1)};
     }
 
     // contented
     void batch_append(PerCoreBuffer *buffer, uint64_t cur_epoch, Stat &stat) {
         minor_gc(cur_epoch, stat);
-        // batch_append from buffer to global array
-        for (auto &[id, version] : buffer->ids_slots_) {
-            append_with_no_gc(id, version);
-        }
+        // batch_append from buffer to global array: one merge of the two
+        // sorted arrays
+        const auto &slots = buffer->sorted_slots();
+        ids_slots_.merge(slots.begin(), slots.end());
         buffer->clear_slots();
     }
 
@@ -148,53 +163,44 @@ class GlobalVersionArray {
 
     void append_with_no_gc(uint64_t serial_id_with_epoch, Version *version) {
         assert(version);
-        // Find the position to append the version
-        auto it =
-            std::upper_bound(ids_slots_.begin(), ids_slots_.end(),
-                             std::make_pair(serial_id_with_epoch, nullptr),
-                             [](const auto &pair, const auto &new_pair) {
-                                 return pair.first < new_pair.first;
-                             });
-
-        // Append to the corresponding position
-        ids_slots_.insert(it, std::make_pair(serial_id_with_epoch, version));
+        ids_slots_.insert(serial_id_with_epoch, version);
     }
 
+    // keeps what the live epochs can read: the versions of the last
+    // NUM_LIVE_EPOCHS epochs and the final state before them
     void minor_gc(uint64_t epoch, Stat &stat) {
         assert(!ids_slots_.empty());
         uint64_t serial_id_with_epoch =
-            convert_to_serial_id_with_epoch(epoch, 0);
+            convert_to_serial_id_with_epoch(epoch + 1 - NUM_LIVE_EPOCHS, 0);
         assert(is_exist_visible_version(serial_id_with_epoch));
-        auto itr = ids_slots_.begin();
-        while (std::next(itr) != ids_slots_.end()) {
-            if (serial_id_with_epoch <= std::next(itr)->first)
-                break;
-
-            /*
-            std::next(itr)->first < cur_epoch のとき、
-            std::next(itr)->firstがfinal stateの候補となるから、
-            その前の、itrは削除可能。
-
-            cur_epoch: 10
-            std::next(itr): 8 8 8 9 9 [9] 10 10
-            */
-            gc(itr, serial_id_with_epoch, stat);
-            itr = ids_slots_.erase(itr);
+        /*
+        ids_slots_[i + 1] < cur_epoch のとき、
+        ids_slots_[i + 1]がfinal stateの候補となるから、
+        その前の、ids_slots_[i]は削除可能。
+
+        cur_epoch: 10
+        ids_slots_[i + 1]: 8 8 8 9 9 [9] 10 10
+        */
+        uint32_t num_older = ids_slots_.rank(serial_id_with_epoch);
+        uint32_t num_gc = num_older == 0 ? 0 : num_older - 1;
+        for (uint32_t i = 0; i < num_gc; i++) {
+            gc(ids_slots_.id_at(i), ids_slots_.value_at(i),
+               serial_id_with_epoch, stat);
         }
+        ids_slots_.erase_front(num_gc);
         assert(!ids_slots_.empty());
         assert(is_exist_visible_version(serial_id_with_epoch));
     }
 
   private:
-    void gc(typename std::vector<std::pair<uint64_t, Version *>>::iterator itr,
+    void gc([[maybe_unused]] uint64_t serial_id, Version *version,
             [[maybe_unused]] uint64_t serial_id_with_epoch, Stat &stat) {
-        auto [serial_id, version] = *itr;
         assert(serial_id < serial_id_with_epoch);
         assert(version);
         assert(version->status == Version::VersionStatus::STABLE);
         assert(version->rec);
-        delete reinterpret_cast<Record *>(version->rec);
-        delete version;
+        version->deallocate_record();
+        EpochArena::destroy(version);
         stat.increment(Stat::MeasureType::Delete);
     }
 
@@ -205,12 +211,11 @@ class RowBuffer { // Caracal's per-core buffer
   public:
     PerCoreBuffer
         *buffers_[LOGICAL_CORE_SIZE]; // TODO: alignas(64) をつけるか検討
+    RowBuffer *next_free_ = nullptr;  // link of RegionPool's free list
 
+    // allocated by the core that grows the pool (see RegionPool)
     RowBuffer() {
-        pid_t main_tid = gettid(); // fetch the main thread's tid
         for (uint64_t core_id = 0; core_id < LOGICAL_CORE_SIZE; core_id++) {
-            Numa numa(main_tid,
-                      core_id); // move to the designated core from main thread
             buffers_[core_id] = new PerCoreBuffer();
         }
     }
@@ -224,20 +229,10 @@ class RowBuffer { // Caracal's per-core buffer
 
 class RowBufferController {
   private:
-    RowBuffer buffers_[NUM_REGIONS];
-    RWLock lock_;
-    uint64_t used_ = 0; // how many buffers currently used
+    RegionPool<RowBuffer> pool_;
 
   public:
-    RowBuffer *fetch_new_buffer() {
-        lock_.lock();
-        assert(used_ < NUM_REGIONS);
-        if (NUM_REGIONS <= used_) {
-            throw std::runtime_error("NUM_REGIONS <= used_");
-        }
-        RowBuffer *buffer = &buffers_[used_]; // TODO: reconsider
-        used_++;
-        lock_.unlock();
-        return buffer;
-    }
+    RowBuffer *fetch_new_buffer(uint64_t core) { return pool_.fetch(core); }
+
+    uint64_t num_allocated_buffers() { return pool_.num_allocated(); }
 };
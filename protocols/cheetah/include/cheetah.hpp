@@ -5,18 +5,24 @@
 #include <set>
 #include <stdexcept>
 #include <unordered_set>
+#include <vector>
 
 #include "indexes/masstree.hpp"
 #include "protocols/cheetah/include/readwriteset.hpp"
 #include "protocols/cheetah/include/value.hpp"
+#include "protocols/common/epoch_arena.hpp"
+#include "protocols/common/memory_allocator.hpp"
 #include "protocols/common/readwritelock.hpp"
+#include "protocols/common/sharded_counter.hpp"
 #include "protocols/common/transaction_id.hpp"
+#include "protocols/ycsb_common/record_misc.hpp"
 #include "utils/bitmap.hpp"
 #include "utils/logger.hpp"
+#include "utils/numa.hpp"
 #include "utils/tsc.hpp"
 #include "utils/utils.hpp"
 
-template <typename Index>
+template <typename Index, typename Allocator, typename Layout>
 class Serval {
  public:
   using Key = typename Index::Key;
@@ -24,8 +30,13 @@ class Serval {
   using LeafNode = typename Index::LeafNode;
   using NodeInfo = typename Index::NodeInfo;
 
-  Serval(uint64_t core_id, uint64_t txid, Stat &stat)
-      : core_(core_id), serial_id_(txid), stat_(stat) {}
+  Serval(uint64_t core_id, uint64_t txid, const Layout &layout, Stat &stat)
+      : core_(core_id),
+        serial_id_(txid),
+        layout_(layout),
+        arena_(EpochArena::get_arena<Allocator>()),
+        shard_(ShardedCounter::shard_of_node(Numa::node_of_cpu(core_id))),
+        stat_(stat) {}
 
   ~Serval() {}
 
@@ -38,8 +49,12 @@ class Serval {
   }
 
   void update_write_bitmaps(TableID table_id, Key key, WriteBitmap *&w_bitmap) {
-    Index &idx = Index::get_index();
+    update_write_bitmaps(table_id, key, find_value(table_id, key), w_bitmap);
+  }
 
+  // val: the row of key, looked up beforehand (see resolve_rows)
+  void update_write_bitmaps(TableID table_id, Key key, Value *val,
+                            WriteBitmap *&w_bitmap) {
     tables.insert(table_id);
     std::vector<Key> &w_table = ws.get_table(table_id);
     assert(w_table.size() <= 10);
@@ -48,18 +63,6 @@ class Serval {
 
     // Case of not append occur
     if (w_iter == w_table.end()) {
-      Value *val;
-      typename Index::Result res =
-          idx.find(table_id, key, val);  // find corresponding index in masstree
-
-      if (res == Index::Result::NOT_FOUND) {
-        assert(false);
-        throw std::runtime_error(
-            "masstree NOT_FOUND");  // TODO: この場合、どうするかを考える
-        return;
-      }
-
-      // Got value from masstree
       w_bitmap = &val->w_bitmap_;
       bitmaps_[w_bitmap] = set_bit_at_the_given_location(
           bitmaps_[w_bitmap], get_tx_serial(serial_id_));
@@ -75,27 +78,32 @@ class Serval {
     // TODO: Case of found in read or written set
   }
 
+  // write phase: the rows of which this core was the final writer in the
+  // previous epoch, whose readers are over (see WriteBitmap::collect())
+  void collect_retired_rows() {
+    for (WriteBitmap *w_bitmap : retired_) {
+      w_bitmap->collect(epoch_ - 1, stat_);
+    }
+    retired_.clear();
+  }
+
+  // publishes the tx bitmap of this core for every row it writes
   void finalize_update_write_bitmaps() {
-    while (!bitmaps_.empty()) {
-      auto itr = bitmaps_.begin();
-      while (itr != bitmaps_.end()) {
-        auto &[w_bitmap, tx_bitmap] = *itr;
-        if (!w_bitmap->lock_.try_lock()) {
-          itr = std::next(itr);
-          continue;
-        }
-        w_bitmap->update_bitmap(core_, tx_bitmap);
-        w_bitmap->lock_.unlock();
-        itr = bitmaps_.erase(itr);
-      }
+    for (auto &[w_bitmap, tx_bitmap] : bitmaps_) {
+      w_bitmap->update_bitmap(core_, tx_bitmap, epoch_, arena_);
     }
-    assert(bitmaps_.empty());
+    bitmaps_.clear();
   }
 
   void append_pending_version(TableID table_id, Key key, Version *&pending,
                               WriteBitmap *&w_bitmap) {
-    Index &idx = Index::get_index();
+    append_pending_version(table_id, key, find_value(table_id, key), pending,
+                           w_bitmap);
+  }
 
+  // val: the row of key, looked up beforehand (see resolve_rows)
+  void append_pending_version(TableID table_id, Key key, Value *val,
+                              Version *&pending, WriteBitmap *&w_bitmap) {
     tables.insert(table_id);
     std::vector<Key> &w_table = ws.get_table(table_id);
     typename std::vector<Key>::iterator w_iter =
@@ -103,21 +111,9 @@ class Serval {
 
     // Case of not append occur
     if (w_iter == w_table.end()) {
-      Value *val;
-      typename Index::Result res =
-          idx.find(table_id, key, val);  // find corresponding index in masstree
-
-      if (res == Index::Result::NOT_FOUND) {
-        assert(false);
-        throw std::runtime_error(
-            "masstree NOT_FOUND");  // TODO: この場合、どうするかを考える
-        return;
-      }
-
-      // Got value from masstree
       w_bitmap = &val->w_bitmap_;
       pending = val->w_bitmap_.append_pending_version(
-          core_, get_tx_serial(serial_id_), stat_);
+          core_, get_tx_serial(serial_id_), epoch_, shard_, arena_, stat_);
       assert(pending);
 
       // Place it in writeset
@@ -131,25 +127,42 @@ class Serval {
   }
 
   const Rec *read([[maybe_unused]] TableID table_id, [[maybe_unused]] Key key,
-                  Version *pending, WriteBitmap *w_bitmap) {
-    Rec *rec = wait_stable_and_execute_read(pending);
-    w_bitmap->decrement_ref_cnt(stat_);
-    return rec;
+                  Version *pending, [[maybe_unused]] WriteBitmap *w_bitmap) {
+    return wait_stable_and_execute_read(pending);
   }
 
-  Rec *write(TableID table_id, WriteBitmap *w_bitmap) {
-    return upsert(table_id, w_bitmap);
+  // nullptr while the pending version is still PENDING: the caller can run
+  // another transaction and retry later instead of spinning.
+  const Rec *try_read([[maybe_unused]] TableID table_id,
+                      [[maybe_unused]] Key key, Version *pending,
+                      [[maybe_unused]] WriteBitmap *w_bitmap) {
+    assert(pending);
+    if (__atomic_load_n(&pending->status, __ATOMIC_SEQ_CST) ==
+        Version::VersionStatus::PENDING) {
+      return nullptr;
+    }
+    return execute_read(pending);
   }
 
-  Rec *upsert(TableID table_id, [[maybe_unused]] WriteBitmap *w_bitmap) {
+  // value: of the update (see write_value())
+  Rec *write(TableID table_id, WriteBitmap *w_bitmap, uint64_t value) {
+    return upsert(table_id, w_bitmap, value);
+  }
+
+  Rec *upsert(TableID table_id, [[maybe_unused]] WriteBitmap *w_bitmap,
+              uint64_t value) {
     const Schema &sch = Schema::get_schema();
     size_t record_size = sch.get_record_size(table_id);
 
     Rec *rec = nullptr;
+    bool is_final;
     Version *pending = w_bitmap->identify_write_version(
-        core_, get_tx_serial(serial_id_), stat_);
+        core_, get_tx_serial(serial_id_), epoch_, arena_, stat_, is_final);
+    if (is_final) retired_.emplace_back(w_bitmap);
     if (pending) {
-      rec = reinterpret_cast<Rec *>(operator new(record_size));
+      rec = reinterpret_cast<Rec *>(
+          pending->allocate_record(arena_, record_size));
+      write_value(rec, record_size, value);  // before the version is STABLE
       __atomic_store_n(&pending->rec, rec, __ATOMIC_SEQ_CST);  // write
       __atomic_store_n(&pending->status, Version::VersionStatus::STABLE,
                        __ATOMIC_SEQ_CST);
@@ -159,8 +172,11 @@ class Serval {
   }
 
   uint64_t core_;
-  uint64_t serial_id_;  // 0 - 4096
+  uint64_t serial_id_;  // 0 - layout_.txs_per_epoch()
+  const Layout layout_;
   uint64_t epoch_ = 0;
+  EpochArena &arena_;  // versions and records of this core
+  unsigned int shard_;  // of the reference counters (the node of the core)
 
  private:
   WriteSet<Key> ws;  // write set
@@ -168,11 +184,30 @@ class Serval {
 
   Stat &stat_;
 
+  // rows of which this core is the final writer, to collect
+  std::vector<WriteBitmap *> retired_;
+
   // <core, txbitmap>
   std::unordered_map<WriteBitmap *, uint64_t> bitmaps_;  // used for write phase
 
-  uint64_t get_core_serial(uint64_t serial_id) { return serial_id / 64; }
-  uint64_t get_tx_serial(uint64_t serial_id) { return serial_id % 64; }
+  Value *find_value(TableID table_id, Key key) {
+    Index &idx = Index::get_index();
+    Value *val;
+    typename Index::Result res =
+        idx.find(table_id, key, val);  // find corresponding index in masstree
+
+    if (res == Index::Result::NOT_FOUND) {
+      assert(false);
+      throw std::runtime_error(
+          "masstree NOT_FOUND");  // TODO: この場合、どうするかを考える
+    }
+    return val;
+  }
+
+  uint64_t get_core_serial(uint64_t serial_id) {
+    return layout_.core(serial_id);
+  }
+  uint64_t get_tx_serial(uint64_t serial_id) { return layout_.tx(serial_id); }
   std::pair<uint64_t, uint64_t> decompose_id_serial(uint64_t serial_id) {
     return {get_core_serial(serial_id), get_tx_serial(serial_id)};
   }
@@ -1,75 +1,118 @@
 #pragma once
 
-#include <algorithm>
 #include <cstdint>
-#include <vector>
+#include <cstring>
+#include <tuple>
 
 #include "benchmarks/ycsb/include/config.hpp"
 #include "protocols/cheetah/include/version.hpp"
-#include "protocols/common/readwritelock.hpp"
+#include "protocols/common/epoch_arena.hpp"
+#include "protocols/common/sharded_counter.hpp"
 #include "utils/bitmap.hpp"
+#include "utils/numa.hpp"
 
 class WriteBitmap {
  public:
-  // incremented in read phase, decremented in write phase
-  alignas(64) uint64_t ref_cnt_ = 0;  // #readers + 1
+  /*
+  the writes of the row in one epoch.
+  allocated by the first writer of the epoch, destroyed by collect().
+  */
+  struct EpochBitmaps {
+    uint64_t epoch_ = 0;
+
+    /*
+     written in write phase by writers: each core stores its tx bitmap into
+     its own slot and sets its bit in core_bitmap_, without lock.
+     read in read phase by readers and in execution phase by writers.
+    */
+    Bitmap<LOGICAL_CORE_SIZE> core_bitmap_;
+    uint64_t tx_bitmaps_[LOGICAL_CORE_SIZE] = {};  // indexed by core
 
-  alignas(64) RWLock lock_;
+    /*
+    placeholders: one slot per write of the epoch, indexed by the rank of
+    the write in serial order (see rank()), so the slots are fixed during
+    the epoch and no lock is needed.
+    allocated by the first reader of a placeholder. claimed with CAS in
+    read phase by readers, which mark the claimed slots in the claimed
+    bitmap. gc by collect(), which only scans the claimed slots.
+    */
+    Version **slots_ = nullptr;  // num_slots_ slots, then claimed bitmap
+    uint32_t num_slots_ = 0;
+  };
 
   /*
-   written in write phase by writers.
-   read in read phase by readers.
-   cleared in execution phase by final writer
+  #readers of the epoch, if the row is written in the epoch.
+  incremented in read phase on the shard of the node of the reader, never
+  decremented: the readers are over after the execution phase, so the
+  final writer or the collection (see collect()) only combine the shards.
   */
-  uint64_t core_bitmap_ = 0;
-  std::vector<uint64_t> tx_bitmaps_;
+  ShardedCounter ref_cnt_;
 
   /*
-  version append in read phase by readers.
-  gc in exec phase by final reader.
+  update in execution phase by final writer. every read of the row loads
+  it.
   */
-  std::unordered_map<uint64_t, Version *> placeholders_;
+  alignas(64) Version *master_ = nullptr;  // final state in one previous epoch
+  Version *previous_master_ = nullptr;     // until collect(), if read
 
   /*
-  update in execution phase by final writer.
+  the writes of the epochs of each parity: epoch e uses bitmaps_[e % 2],
+  while the final writer of e - 1 collects the other one. nullptr if the
+  row is not written in the epoch.
   */
-  Version *master_ = nullptr;  // final state in one previous epoch
-  Version *previous_master_ = nullptr;
-
-  // write phase: should be called with lock
-  void update_bitmap(uint64_t core, uint64_t tx_bitmap) {
-    int insert_pos = count_prefix_sum(core);
-    assert(!is_bit_set_at_the_position(core_bitmap_, core));
-    insert_tx_bitmap(insert_pos, tx_bitmap);
-    update_core_bitmap(core);
-    assert(is_bit_set_at_the_position(core_bitmap_, core));
+  EpochBitmaps *bitmaps_[2] = {};
+
+  // write phase, without lock
+  void update_bitmap(uint64_t core, uint64_t tx_bitmap, uint64_t epoch,
+                     EpochArena &arena) {
+    EpochBitmaps *&current = bitmaps_[epoch % 2];
+    EpochBitmaps *bitmaps = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+    if (!bitmaps) {  // first writer of the epoch
+      EpochBitmaps *created = arena.create<EpochBitmaps>();
+      created->epoch_ = epoch;
+      if (__atomic_compare_exchange_n(&current, &bitmaps, created, false,
+                                      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        bitmaps = created;
+      } else {  // another writer allocated them first
+        EpochArena::destroy(created);
+      }
+    }
+    assert(bitmaps->epoch_ == epoch);
+    assert(!bitmaps->core_bitmap_.test_atomic(core));
+    __atomic_store_n(&bitmaps->tx_bitmaps_[core], tx_bitmap, __ATOMIC_RELAXED);
+    bitmaps->core_bitmap_.set_atomic(core);
   }
 
   /*
   read phase
   */
-  Version *append_pending_version(uint64_t core, uint64_t tx, Stat &stat) {
-    uint64_t ref_cnt = __atomic_fetch_add(&ref_cnt_, 1, __ATOMIC_SEQ_CST);
-    if (ref_cnt == 0) {
-      __atomic_fetch_add(&ref_cnt_, 1, __ATOMIC_SEQ_CST);  // for #readers + 1
-    }
-
-    if (core_bitmap_) {  // write occur in this epoch
+  Version *append_pending_version(uint64_t core, uint64_t tx, uint64_t epoch,
+                                  unsigned int shard, EpochArena &arena,
+                                  Stat &stat) {
+    EpochBitmaps *bitmaps = bitmaps_[epoch % 2];
+    if (bitmaps) {  // write occur in this epoch
+      assert(bitmaps->epoch_ == epoch);
+      ref_cnt_.increment(shard);
       auto [is_found, visible_core, visible_tx] =
-          identify_visible_version_in_bitmaps(core, tx);
+          identify_visible_version_in_bitmaps(*bitmaps, core, tx);
 
       if (is_found) {  // read the version created in this epoch
-        uint64_t visible_id = get_serial_id(visible_core, visible_tx);
-
-        // ***************** should be atomic *****************
-        lock_.lock();
-        Version *v = placeholders_[visible_id];
-        if (!v) {  // visible_id is not exsit in placeholders_
-          v = create_pending_version(stat);  // placeholderを新規作成
-          placeholders_[visible_id] = v;
+        Version **slots = allocate_slots(*bitmaps, arena);
+        uint32_t r = rank(*bitmaps, visible_core, visible_tx);
+        Version *v = __atomic_load_n(&slots[r], __ATOMIC_ACQUIRE);
+        if (!v) {  // first reader of the version: claim the slot
+          Version *created = create_pending_version(arena, stat);
+          if (__atomic_compare_exchange_n(&slots[r], &v, created, false,
+                                          __ATOMIC_ACQ_REL,
+                                          __ATOMIC_ACQUIRE)) {
+            v = created;
+            __atomic_fetch_or(&claimed(*bitmaps)[r / 64], 1ULL << (r % 64),
+                              __ATOMIC_RELEASE);
+          } else {  // another reader claimed it first
+            EpochArena::destroy(created);
+            stat.increment(Stat::MeasureType::Delete);
+          }
         }
-        lock_.unlock();
-        // ***************** should be atomic *****************
 
         assert(v);
         return v;
@@ -77,206 +120,200 @@ class WriteBitmap {
       assert(master_->status == Version::VersionStatus::STABLE);
       assert(master_);
       return master_;  // read the master version
-    } else {
-      // for debug
-      assert(placeholders_.empty());
     }
     assert(master_);
     assert(master_->status == Version::VersionStatus::STABLE);
     return master_;  // this is read only record
   }
 
-  // execute read
-  void decrement_ref_cnt([[maybe_unused]] Stat &stat) {
-    [[maybe_unused]] uint64_t ref_cnt =
-        __atomic_sub_fetch(&ref_cnt_, 1, __ATOMIC_SEQ_CST);
+  /*
+  after the execution phase of epoch, by the core of the final writer of
+  the row in epoch (write phase of epoch + 1): all the readers are over,
+  so gc the master they may have read and the claimed placeholders.
+  */
+  void collect(uint64_t epoch, Stat &stat) {
+    EpochBitmaps *&bitmaps = bitmaps_[epoch % 2];
+    assert(bitmaps && bitmaps->epoch_ == epoch);
+
+    if (0 < ref_cnt_.sum()) {
+      ref_cnt_.reset();
 
-    if (ref_cnt == 1) {
-      // ***************** should be atomic *****************
-      lock_.lock();
       // 1. gc previous master
-      if (previous_master_) {  // final writer lock < final reader lock
-        gc(previous_master_, stat);
-        assert(master_);
-      }
+      gc(previous_master_, stat);
+      assert(master_);
 
-      // if any append in placeholders occur...
-      // 2. gc placeholders
-      if (!placeholders_.empty()) {
-        // last writerのversionは絶対に含まれていないことは保証されている
-        for (auto &[id, version] : placeholders_) {
-          assert(version->status == Version::VersionStatus::STABLE);
-          gc(version, stat);
+      // 2. gc the claimed placeholders
+      // the final version is not among them: its writer took it out
+      if (bitmaps->slots_) {
+        uint64_t *claimed_words = claimed(*bitmaps);
+        for (uint32_t w = 0; w * 64 < bitmaps->num_slots_; w++) {
+          while (claimed_words[w]) {
+            uint32_t r = w * 64 + __builtin_ctzll(claimed_words[w]);
+            claimed_words[w] &= claimed_words[w] - 1;
+            Version *&version = bitmaps->slots_[r];
+            if (version) gc(version, stat);
+          }
         }
-        placeholders_.clear();
+        EpochArena::deallocate(bitmaps->slots_);
       }
-
-      assert(previous_master_ == nullptr);
-      assert(placeholders_.empty());
-      __atomic_sub_fetch(&ref_cnt_, 1, __ATOMIC_SEQ_CST);
-      // once gc by final reader finish, ref_cnt_ become 0.
-      lock_.unlock();
-      // ***************** should be atomic *****************
     }
-  }
-
-  // execute write
-  Version *identify_write_version(uint64_t core, uint64_t tx,
-                                  [[maybe_unused]] Stat &stat) {
-    Version *version = nullptr;
-    uint64_t serial_id = get_serial_id(core, tx);
-
-    lock_.lock();
-    auto itr = placeholders_.find(serial_id);
-
-    if (is_final_state(core, tx)) {
-      // ***************** should be atomic *****************
-
-      // 1. final writer should create final version
-      if (itr == placeholders_.end()) {
-        version = create_pending_version(stat);
-      } else {  // final version is already created in the placeholders_
-        version = itr->second;
-        placeholders_.erase(itr);
-        // 今後のreaderが間違ってfinal
-        // versionをGCしないようにplaceholders_から削除しておく
-      }
-
-      /*
-       2. final writer is responsible for...
-       - A. when final writer comes after final reader
-       - or in the write only workload, (i.e. ref_cnt == 0)
-       - final writer should gc master_ and assign final state to master_.
-       - B. if any reader will come after the final writer, (i.e. 0 < ref_cnt)
-       - final writer should stash current master_ to previous_master_.
-       - (because some reader is using current master_)
-       - then, assign final state to master_.
-      */
-      if (__atomic_load_n(&ref_cnt_, __ATOMIC_SEQ_CST) ==
-          0) {  // final reader lock < final writer lock or write only
-        // gc master
-        gc(master_, stat);  // もう誰からも読まれない
-        assert(placeholders_.empty());
-      } else {
-        previous_master_ = master_;  // 今後のreaderのために残しておく
-      }
-      master_ = version;  // assign final state to master_
+    assert(previous_master_ == nullptr);
 
-      // 3. final writer is responsible for clear bitmaps.
-      if (core_bitmap_) {
-        clear_bitmaps();
-      }
+    EpochArena::destroy(bitmaps);
+    bitmaps = nullptr;
+  }
 
-      assert(core_bitmap_ == 0);
-      assert(tx_bitmaps_.empty());
+  /*
+  execute write. is_final is set for the final writer, which must collect()
+  the row after the execution phase.
+  */
+  Version *identify_write_version(uint64_t core, uint64_t tx, uint64_t epoch,
+                                  EpochArena &arena,
+                                  [[maybe_unused]] Stat &stat, bool &is_final) {
+    EpochBitmaps &bitmaps = *bitmaps_[epoch % 2];
+    assert(bitmaps.epoch_ == epoch);
+    Version **slots = bitmaps.slots_;  // fixed since read phase
+
+    is_final = is_final_state(bitmaps, core, tx);
+    if (!is_final) {  // the placeholder of its readers, if any
+      return slots ? __atomic_load_n(&slots[rank(bitmaps, core, tx)],
+                                     __ATOMIC_ACQUIRE)
+                   : nullptr;
+    }
 
-      // ***************** should be atomic *****************
+    // 1. final writer should create final version
+    // (or take it out of the placeholders, so that collect() does not gc
+    // it)
+    Version *version = slots ? __atomic_exchange_n(
+                                   &slots[rank(bitmaps, core, tx)], nullptr,
+                                   __ATOMIC_ACQ_REL)
+                             : nullptr;
+    if (!version) version = create_pending_version(arena, stat);
 
+    /*
+     2. final writer is responsible for...
+     - A. in the write only workload, (i.e. no reader in this epoch: the
+     - read phase is over, so ref_cnt_ is final)
+     - final writer should gc master_ and assign final state to master_.
+     - B. if any reader is in this epoch,
+     - final writer should stash current master_ to previous_master_.
+     - (because some reader may be using current master_)
+     - then, assign final state to master_.
+    */
+    if (ref_cnt_.sum() == 0) {
+      // gc master
+      gc(master_, stat);  // もう誰からも読まれない
     } else {
-      if (itr != placeholders_.end()) {
-        version = itr->second;
-      }
+      previous_master_ = master_;  // 今後のreaderのために残しておく
     }
-    lock_.unlock();
-
-    return version;
-  }
+    master_ = version;  // assign final state to master_
 
-  int count_prefix_sum(uint64_t core) {
-    /*
-    core: 4
-    0010 [1]000 ...: prefix_sum　is 1
+    // the bitmaps stay: the other writers of the epoch still rank on them
 
-    core: 4
-    0011 [1]000 ...: prefix_sum　is is 2
-    */
-    return count_bits(core_bitmap_ &
-                      fill_the_left_side_until_before_the_given_position(core));
+    return version;
   }
 
  private:
   void gc(Version *&version, Stat &stat) {
     assert(version);
     assert(version->status == Version::VersionStatus::STABLE);
-    delete reinterpret_cast<Record *>(version->rec);
-    delete version;
+    version->deallocate_record();
+    EpochArena::destroy(version);
     stat.increment(Stat::MeasureType::Delete);
     version = nullptr;
   }
 
-  uint64_t get_serial_id(uint64_t core, uint64_t tx) { return core * 64 + tx; }
-
-  void clear_bitmaps() {
-    core_bitmap_ = 0;
-    tx_bitmaps_.clear();
+  static uint64_t *claimed(EpochBitmaps &bitmaps) {
+    return reinterpret_cast<uint64_t *>(bitmaps.slots_ + bitmaps.num_slots_);
   }
-  // execute write
-  bool is_final_state(uint64_t core, uint64_t tx) {
-    bool is_final = false;
-    if (core_bitmap_) {
-      uint64_t last_core = find_the_largest(core_bitmap_);
-      if (last_core == core) {
-        assert(tx_bitmaps_.back());
-        uint64_t last_tx = find_the_largest(tx_bitmaps_.back());
-        if (last_tx == tx) is_final = true;
-      }
+
+  // read phase: the slots of the placeholders, allocated by the first
+  // reader that needs one
+  Version **allocate_slots(EpochBitmaps &bitmaps, EpochArena &arena) {
+    Version **slots = __atomic_load_n(&bitmaps.slots_, __ATOMIC_ACQUIRE);
+    if (slots) return slots;
+
+    uint32_t n = rank(bitmaps, LOGICAL_CORE_SIZE, 0);  // all the writes
+    n = (n + 63) & ~63u;  // whole words of claimed bitmap
+    size_t size = n * sizeof(Version *) + n / 64 * 8;
+    Version **created = static_cast<Version **>(arena.allocate(size, 64));
+    memset(created, 0, size);
+    // the same n for every reader: the bitmaps are fixed
+    __atomic_store_n(&bitmaps.num_slots_, n, __ATOMIC_RELAXED);
+    if (__atomic_compare_exchange_n(&bitmaps.slots_, &slots, created, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      return created;
     }
-    return is_final;
+    EpochArena::deallocate(created);  // another reader allocated them first
+    return slots;
   }
 
-  void update_tx_bitmap(int pos, uint64_t tx) {
-    assert(pos < (int)tx_bitmaps_.size());
-    tx_bitmaps_[pos] = set_bit_at_the_given_location(tx_bitmaps_[pos], tx);
-  }
-  void insert_tx_bitmap(int insert_pos, uint64_t tx_bitmap) {
-    tx_bitmaps_.insert(tx_bitmaps_.begin() + insert_pos, tx_bitmap);
+  // rank of the write of (core, tx) among the writes of the epoch, in serial
+  // order, i.e. the number of writes before it
+  static uint32_t rank(const EpochBitmaps &bitmaps, uint64_t core,
+                       uint64_t tx) {
+    uint32_t r = 0;
+    for (uint64_t c = 0; c < core; c++) {
+      r += count_bits(bitmaps.tx_bitmaps_[c]);
+    }
+    if (core < LOGICAL_CORE_SIZE) {
+      // tx i is the bit 63 - i (see set_bit_at_the_given_location)
+      uint64_t smaller_txs = ~(~0ULL >> tx);
+      r += count_bits(bitmaps.tx_bitmaps_[core] & smaller_txs);
+    }
+    return r;
   }
-  void update_core_bitmap(uint64_t core) {
-    core_bitmap_ = set_bit_at_the_given_location(core_bitmap_, core);
+
+  // execute write
+  static bool is_final_state(const EpochBitmaps &bitmaps, uint64_t core,
+                             uint64_t tx) {
+    int last_core = bitmaps.core_bitmap_.find_largest();
+    assert(last_core != -1);
+    if ((uint64_t)last_core != core) return false;
+    assert(bitmaps.tx_bitmaps_[core]);
+    return (uint64_t)find_the_largest(bitmaps.tx_bitmaps_[core]) == tx;
   }
 
   // read phase
-  std::tuple<bool, uint64_t, uint64_t> identify_visible_version_in_bitmaps(
-      uint64_t core, uint64_t tx) {
+  static std::tuple<bool, uint64_t, uint64_t>
+  identify_visible_version_in_bitmaps(const EpochBitmaps &bitmaps,
+                                      uint64_t core, uint64_t tx) {
     auto [second_core, first_core] =
-        find_the_two_largest_among_or_less_than(core_bitmap_, core);
+        bitmaps.core_bitmap_.find_two_largest_among_or_less_than(core);
 
     if (first_core == -1) {
       assert(first_core == -1 && second_core == -1);
       return {false, 0, 0};
     }
 
-    int first_core_pos = count_prefix_sum(first_core);
-    assert(first_core_pos < (int)tx_bitmaps_.size());
-
     if (first_core == (int)core) {
-      int first_tx =
-          find_the_largest_among_less_than(tx_bitmaps_[first_core_pos], tx);
+      int first_tx = find_the_largest_among_less_than(
+          bitmaps.tx_bitmaps_[first_core], tx);
 
       if (first_tx != -1) {
         return {true, first_core, first_tx};
       }
 
       if (second_core != -1) {
-        int second_core_pos = count_prefix_sum(second_core);
-        assert(second_core_pos < first_core_pos);
+        assert(second_core < first_core);
         return {true, second_core,
-                find_the_largest(tx_bitmaps_[second_core_pos])};
+                find_the_largest(bitmaps.tx_bitmaps_[second_core])};
       }
 
       return {false, 0, 0};
     }
 
     assert(0 <= first_core && (uint64_t)first_core < core);
-    return {true, first_core, find_the_largest(tx_bitmaps_[first_core_pos])};
+    return {true, first_core,
+            find_the_largest(bitmaps.tx_bitmaps_[first_core])};
   }
 
-  Version *create_pending_version(Stat &stat) {
-    Version *version = new Version;
+  Version *create_pending_version(EpochArena &arena, Stat &stat) {
+    Version *version = arena.create<Version>();
     version->rec = nullptr;  // TODO
     version->deleted = false;
     version->status = Version::VersionStatus::PENDING;
     stat.increment(Stat::MeasureType::Create);
     return version;
   }
-};
\ No newline at end of file
+};
@@ -1,10 +1,7 @@
 #pragma once
 
-class Version {
-  public:
-    enum class VersionStatus { PENDING, STABLE }; // status of version
+#include "protocols/common/version.hpp"
+#include "protocols/ycsb_common/definitions.hpp"
 
-    alignas(64) void *rec = nullptr; // nullptr if deleted = true (immutable)
-    VersionStatus status;
-    bool deleted; // (immutable)
-};
+// records of PAYLOAD_SIZE bytes or less are stored in the version
+using Version = InlineVersion<sizeof(Record)>;
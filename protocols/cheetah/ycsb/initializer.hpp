@@ -1,45 +1,85 @@
 #pragma once
 
+#include <cassert>
+#include <cstring>
+
 #include "benchmarks/ycsb/include/config.hpp"
 #include "benchmarks/ycsb/include/record_key.hpp"
 #include "benchmarks/ycsb/include/record_layout.hpp"
+#include "protocols/common/epoch_arena.hpp"
 #include "protocols/common/memory_allocator.hpp"
 #include "protocols/common/schema.hpp"
 #include "protocols/common/tidword.hpp"
+#include "protocols/ycsb_common/parallel_loader.hpp"
 #include "protocols/ycsb_common/record_misc.hpp"
+#include "protocols/ycsb_common/snapshot.hpp"
+#include "protocols/ycsb_common/value_slab.hpp"
 #include "utils/numa.hpp"
 #include "utils/utils.hpp"
 
-template <typename Index> class Initializer {
+template <typename Index, typename Allocator> class Initializer {
   private:
     using Key = typename Index::Key;
     using Value = typename Index::Value;
 
-    static void insert_into_index(TableID table_id, Key key, void *rec) {
-        Value *val = new Value;
-
-        Version *version = new Version;
+    // a stable version with a new record (inside the version if it fits),
+    // or a copy of image if it is not nullptr
+    template <typename Record>
+    static Version *create_stable_version(const void *image) {
+        EpochArena &arena = EpochArena::get_arena<Allocator>();
+        Version *version = arena.template create<Version>();
+        Record *rec =
+            new (version->allocate_record(arena, sizeof(Record))) Record;
+        if (image)
+            memcpy(rec, image, sizeof(Record));
         version->rec = rec;
         version->status = Version::VersionStatus::STABLE;
+        return version;
+    }
+
+    template <typename Record>
+    static void insert_into_index(ValueSlab<Value, Allocator> &slab,
+                                  TableID table_id, Key key,
+                                  const void *image) {
+        Value *val = new (slab.allocate(key)) Value;
+
+        Version *version = create_stable_version<Record>(image);
         val->w_bitmap_.master_ = version;
 
         Index::get_index().insert(table_id, key, val);
     }
 
   public:
-    template <typename Record> static void load_all_tables() {
+    // the latest committed record of key, while no epoch runs
+    template <typename Record> static const void *committed_record(Key key) {
+        Value *val;
+        [[maybe_unused]] auto res = Index::get_index().find(get_id<Record>(),
+                                                            key, val);
+        assert(res == Index::Result::OK);
+        return val->w_bitmap_.master_->rec;
+    }
+
+    // loads the tables with num_threads loader threads, pinned like the
+    // workers (see parallel_load()), from the snapshot of the Config if it
+    // exists (see load_table())
+    template <typename Record>
+    static void load_all_tables(uint64_t num_threads) {
         Schema &sch = Schema::get_mutable_schema();
         sch.set_record_size(get_id<Record>(), sizeof(Record));
 
         const Config &c = get_config();
 
-        pid_t tid = gettid(); // fetch the thread's tid
-        Numa numa(tid, 0);    // move to the designated core
-        std::cout << "database is in node" << numa.node_ << std::endl;
+        ValueSlab<Value, Allocator> slab(c.get_num_records());
 
-        for (uint64_t key = 0; key < c.get_num_records(); key++) {
-            void *rec = reinterpret_cast<void *>(new Record());
-            insert_into_index(get_id<Record>(), key, rec);
-        }
+        Index &idx = Index::get_index();
+        TableID table_id = get_id<Record>();
+        idx.create_table(table_id);
+        load_table(
+            table_id, sizeof(Record), c.get_num_records(), num_threads,
+            c.get_snapshot_path(),
+            [&](uint64_t key, const void *image) {
+                insert_into_index<Record>(slab, table_id, key, image);
+            },
+            [](uint64_t key) { return committed_record<Record>(key); });
     }
 };
\ No newline at end of file
@@ -1,12 +1,97 @@
 #pragma once
 
+#include <sched.h> // getcpu
+
+#include <cstddef>
+#include <mutex>
+
 #include "mimalloc/include/mimalloc.h"
 
+/*
+  Allocator policies of the protocols and the initializers.
+  A policy provides
+
+    static void *allocate(size_t size);
+    static void *aligned_allocate(size_t size, size_t align);
+    static void deallocate(void *ptr);
+
+  and memory returned by any of them can be deallocated by any thread.
+*/
+
 class MemoryAllocator {
 public:
     static void* allocate(size_t size) { return mi_malloc(size); }
 
-    static void* aligned_allocate(size_t size) { return mi_malloc(size); }
+    static void* aligned_allocate(size_t size, size_t align = 64) {
+        return mi_malloc_aligned(size, align);
+    }
+
+    static void deallocate(void* ptr) { return mi_free(ptr); }
+};
+
+/*
+  Every thread allocates from its own mimalloc heap, and the heap lives in an
+  exclusive arena of the NUMA node the thread runs on. The arena is reserved
+  without committing it, so its pages are placed by the first touch of the
+  threads of that node. The thread has to be pinned (see Numa) before its
+  first allocation. If no arena can be reserved, a plain heap of the thread
+  is used instead.
+
+  An arena never grows, and a heap in an arena does not fall back to the OS:
+  once the arena of the node is full (e.g. a large load with all the workers
+  on one node), the blocks come from the default heap of the thread. They
+  are still placed by the first touch of the pinned thread.
+*/
+class NumaLocalAllocator {
+public:
+    static constexpr size_t ARENA_SIZE = 1ULL << 34; // address space per node
+    static constexpr unsigned int MAX_NODES = 8;
+
+    static void* allocate(size_t size) {
+        void* ptr = mi_heap_malloc(get_heap(), size);
+        return ptr ? ptr : mi_malloc(size); // the arena is full
+    }
+
+    static void* aligned_allocate(size_t size, size_t align = 64) {
+        void* ptr = mi_heap_malloc_aligned(get_heap(), size, align);
+        return ptr ? ptr : mi_malloc_aligned(size, align); // the arena is full
+    }
 
     static void deallocate(void* ptr) { return mi_free(ptr); }
-};
\ No newline at end of file
+
+private:
+    // The heap is never deleted: blocks of the final versions must stay
+    // valid after the worker threads exit.
+    static mi_heap_t* get_heap() {
+        thread_local mi_heap_t* heap = create_heap();
+        return heap;
+    }
+
+    static mi_heap_t* create_heap() {
+        unsigned int cpu, node;
+        mi_arena_id_t arena_id;
+        mi_heap_t* heap = nullptr;
+        if (getcpu(&cpu, &node) == 0 && get_node_arena(node, arena_id)) {
+            heap = mi_heap_new_in_arena(arena_id);
+        }
+        return heap ? heap : mi_heap_new();
+    }
+
+    static bool get_node_arena(unsigned int node, mi_arena_id_t& arena_id) {
+        static std::mutex mtx;
+        static mi_arena_id_t arena_ids[MAX_NODES];
+        static int reserved[MAX_NODES]; // 0: not yet, 1: ok, -1: failed
+
+        if (MAX_NODES <= node) return false;
+        std::lock_guard<std::mutex> lock(mtx);
+        if (reserved[node] == 0) {
+            int err = mi_reserve_os_memory_ex(ARENA_SIZE, false /* commit */,
+                                              true /* allow_large */,
+                                              true /* exclusive */,
+                                              &arena_ids[node]);
+            reserved[node] = err ? -1 : 1;
+        }
+        arena_id = arena_ids[node];
+        return reserved[node] == 1;
+    }
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+#include "protocols/common/readwritelock.hpp"
+#include "utils/numa.hpp"
+
+/*
+  Growable pool of row regions (Serval's RowRegion, Caracal's RowBuffer).
+
+  Every core has its own free list, a Treiber stack linked through
+  Region::next_free_. Only the owner core pops from its list (initialization
+  phase, core_ == worker id), so a pop cannot suffer from ABA: between
+  reading head and next, other cores can only push in front of head.
+  Pushes may come from any core.
+
+  When the free list of a core is empty, the core allocates GROW_BATCH
+  regions at once, takes one and puts the rest on its own free list. The
+  regions are allocated by the core that uses them first and are never
+  returned to the system until the pool is destroyed.
+*/
+template <typename Region> class RegionPool {
+  public:
+    static constexpr uint64_t GROW_BATCH = 64;
+
+    RegionPool() = default;
+    RegionPool(const RegionPool &) = delete;
+    RegionPool &operator=(const RegionPool &) = delete;
+
+    ~RegionPool() {
+        for (Region *batch : batches_) {
+            delete[] batch;
+        }
+    }
+
+    Region *fetch(uint64_t core) {
+        assert(core < LOGICAL_CORE_SIZE);
+        Region *region = pop(free_lists_[core]);
+        if (!region) {
+            region = grow(core);
+        }
+        assert(region);
+        region->next_free_ = nullptr;
+        return region;
+    }
+
+    // the region must not be reachable from any row anymore
+    void release(uint64_t core, Region *region) {
+        assert(core < LOGICAL_CORE_SIZE);
+        assert(region);
+        push(free_lists_[core], region);
+    }
+
+    uint64_t num_allocated() {
+        return __atomic_load_n(&num_allocated_, __ATOMIC_SEQ_CST);
+    }
+
+  private:
+    struct FreeList {
+        alignas(64) Region *head_ = nullptr;
+    };
+
+    FreeList free_lists_[LOGICAL_CORE_SIZE];
+
+    RWLock lock_; // protects batches_
+    std::vector<Region *> batches_;
+    uint64_t num_allocated_ = 0;
+
+    static void push(FreeList &list, Region *region) {
+        Region *head = __atomic_load_n(&list.head_, __ATOMIC_SEQ_CST);
+        do {
+            region->next_free_ = head;
+        } while (!__atomic_compare_exchange_n(&list.head_, &head, region,
+                                              false, __ATOMIC_SEQ_CST,
+                                              __ATOMIC_SEQ_CST));
+    }
+
+    // single popper per list
+    static Region *pop(FreeList &list) {
+        Region *head = __atomic_load_n(&list.head_, __ATOMIC_SEQ_CST);
+        while (head) {
+            Region *next = head->next_free_;
+            if (__atomic_compare_exchange_n(&list.head_, &head, next, false,
+                                            __ATOMIC_SEQ_CST,
+                                            __ATOMIC_SEQ_CST)) {
+                return head;
+            }
+        }
+        return nullptr;
+    }
+
+    Region *grow(uint64_t core) {
+        Region *batch = new Region[GROW_BATCH];
+
+        lock_.lock();
+        batches_.emplace_back(batch);
+        lock_.unlock();
+        __atomic_add_fetch(&num_allocated_, GROW_BATCH, __ATOMIC_SEQ_CST);
+
+        for (uint64_t i = 1; i < GROW_BATCH; i++) {
+            push(free_lists_[core], &batch[i]);
+        }
+        return &batch[0];
+    }
+};
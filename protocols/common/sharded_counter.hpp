@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+  Counter sharded over the NUMA nodes: the threads of a node only increment
+  the cache line of their node, so a hot counter is not bounced between the
+  sockets. The shards are only combined (sum()) once the increments are
+  over, e.g. after a barrier. The nodes beyond NUM_SHARDS share the shards.
+*/
+class ShardedCounter {
+  public:
+    static constexpr unsigned int NUM_SHARDS = 2;
+
+    static unsigned int shard_of_node(unsigned int node) {
+        return node % NUM_SHARDS;
+    }
+
+    void increment(unsigned int shard) {
+        __atomic_fetch_add(&shards_[shard].cnt_, 1, __ATOMIC_RELAXED);
+    }
+
+    uint64_t sum() const {
+        uint64_t sum = 0;
+        for (const Shard &shard : shards_) {
+            sum += __atomic_load_n(&shard.cnt_, __ATOMIC_RELAXED);
+        }
+        return sum;
+    }
+
+    void reset() {
+        for (Shard &shard : shards_) {
+            shard.cnt_ = 0;
+        }
+    }
+
+  private:
+    struct alignas(64) Shard {
+        uint64_t cnt_ = 0;
+    };
+    Shard shards_[NUM_SHARDS];
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include "protocols/common/epoch_arena.hpp"
+
+/*
+  A version of a row, for records of RecordSize bytes.
+
+  A record that fits in the first two lines of the version, after its
+  header, is stored in the version itself: rec points into the version, so
+  a read touches the line(s) of the version only and a write does not
+  allocate. Larger records (also larger ones given at runtime by the
+  Schema) are allocated out of line from the arena, as before. Readers
+  always go through rec and do not care where the record is.
+
+      RecordSize <= 48:  [rec | status | deleted | record ]  one line
+      RecordSize <= 112: [rec | status | deleted | record     ]  two lines
+      otherwise:         [rec | status | deleted]  -> record
+*/
+template <size_t RecordSize> class InlineVersion {
+  public:
+    enum class VersionStatus { PENDING, STABLE }; // status of version
+
+    static constexpr size_t HEADER_SIZE = 16; // rec, status, deleted
+    static constexpr size_t MAX_INLINE_RECORD_SIZE = 2 * 64 - HEADER_SIZE;
+    static constexpr size_t INLINE_RECORD_SIZE =
+        RecordSize <= MAX_INLINE_RECORD_SIZE ? RecordSize : 0;
+
+    alignas(64) void *rec = nullptr; // nullptr if deleted = true (immutable)
+    VersionStatus status;
+    bool deleted; // (immutable)
+
+    InlineVersion() = default;
+    // rec may point into the version
+    InlineVersion(const InlineVersion &) = delete;
+    InlineVersion &operator=(const InlineVersion &) = delete;
+
+    // memory for a record of size bytes: inside the version if it fits,
+    // from arena otherwise. The caller publishes it by storing it to rec
+    void *allocate_record(EpochArena &arena, size_t size) {
+        if (size <= INLINE_RECORD_SIZE)
+            return record_;
+        return arena.allocate(size);
+    }
+
+    // frees rec unless it is inside the version
+    void deallocate_record() {
+        assert(rec);
+        if (rec != record_)
+            EpochArena::deallocate(rec);
+    }
+
+  private:
+    alignas(16) unsigned char
+        record_[INLINE_RECORD_SIZE == 0 ? 1 : INLINE_RECORD_SIZE];
+};
+
+static_assert(sizeof(InlineVersion<48>) == 64);
+static_assert(sizeof(InlineVersion<112>) == 128);
+static_assert(sizeof(InlineVersion<1024>) == 64);
@@ -14,7 +14,8 @@ class MajorGC {
     values_[cur_epoch].insert(value);
   }
 
-  void major_gc(uint64_t core, uint64_t new_epoch, Stat &stat) {
+  void major_gc(uint64_t core, uint64_t new_epoch, RowRegionController &rrc,
+                Stat &stat) {
     if (values_.empty()) return;
 
     auto itr = values_.begin();
@@ -25,7 +26,7 @@ class MajorGC {
       // (new_epoch - k_) > epoch
       // であるようなg_arrayにアクセスしてGCを行う
       for (auto &val : vals) {
-        uint64_t val_epoch = __atomic_load_n(&val->epoch_, __ATOMIC_SEQ_CST);
+        uint64_t val_epoch = val->epoch();
 
         /*
         [val_epoch == new_epoch]
@@ -46,26 +47,26 @@ class MajorGC {
 
         if (val_epoch == new_epoch) {
           // 自分のper core version　arrayのみをGC
-          if (val->row_region_) {
-            val->row_region_->gc_and_initialize_tx_bitmap(core, stat);
+          if (RowRegion *region = val->state(new_epoch).row_region_) {
+            region->gc_and_initialize_tx_bitmap(core, stat);
           }
         } else {
           uint64_t start = rdtscp();
           val->lock();
           stat.add(Stat::MeasureType::WaitInGC, rdtscp() - start);
           // 再度チェック
-          if (__atomic_load_n(&val->epoch_, __ATOMIC_SEQ_CST) == new_epoch) {
+          if (val->epoch() == new_epoch) {
             val->unlock();
             // 自分のper core version　arrayのみをGC
-            if (val->row_region_) {
-              val->row_region_->gc_and_initialize_tx_bitmap(core, stat);
+            if (RowRegion *region = val->state(new_epoch).row_region_) {
+              region->gc_and_initialize_tx_bitmap(core, stat);
             }
           } else {
             // global arrayをGC
             // 自分のper core version　arrayのみをGC
-            val->initialize_the_row(new_epoch, stat);
-            if (val->row_region_) {
-              val->row_region_->gc_and_initialize_tx_bitmap(core, stat);
+            val->initialize_the_row(new_epoch, rrc, core, stat);
+            if (RowRegion *region = val->state(new_epoch).row_region_) {
+              region->gc_and_initialize_tx_bitmap(core, stat);
             }
             val->unlock();
           }
@@ -4,7 +4,10 @@
 #include <vector>
 
 #include "benchmarks/ycsb/include/config.hpp"
+#include "protocols/common/memory_allocator.hpp"
+#include "protocols/ycsb_common/command_log.hpp"
 #include "protocols/serval/include/row_region.hpp"
+#include "protocols/serval/include/value.hpp"
 
 class Operation {
  public:
@@ -13,6 +16,10 @@ class Operation {
   uint64_t index_;
   uint64_t value_ = 0;
 
+  Value *val_ = nullptr;
+  // the row of index_, resolved once in the initialization phase
+  // (resolve_rows)
+
   Version *pending_ = nullptr;
   // pending version is installed in initialization phase
   // used in execution phase for write
@@ -79,13 +86,11 @@ class OperationSet {
           }
           Operation *ope;
           if (operationType <= c.get_read_propotion()) {
-              // ope = new (MemoryAllocator::allocate(sizeof(Operation)))
-              //     Operation(Operation::Ope::Read, key);
-              ope = new Operation(Operation::Ope::Read, three_of_ten_key);
+              ope = new (MemoryAllocator::allocate(sizeof(Operation)))
+                  Operation(Operation::Ope::Read, three_of_ten_key);
           } else {
-              // ope = new (MemoryAllocator::allocate(sizeof(Operation)))
-              //     Operation(Operation::Ope::Update, key);
-              ope = new Operation(Operation::Ope::Update, three_of_ten_key);
+              ope = new (MemoryAllocator::allocate(sizeof(Operation)))
+                  Operation(Operation::Ope::Update, three_of_ten_key);
               w_set_.emplace_back(ope);
           }
           rw_set_.emplace_back(ope);
@@ -106,22 +111,47 @@ class OperationSet {
           // contented_keys[urand_int(0, 76)]; // TODO: change
           Operation *ope;
           if (operationType <= c.get_read_propotion()) {
-              // ope = new (MemoryAllocator::allocate(sizeof(Operation)))
-              //     Operation(Operation::Ope::Read, key);
-              ope = new Operation(Operation::Ope::Read, seven_of_ten_key);
+              ope = new (MemoryAllocator::allocate(sizeof(Operation)))
+                  Operation(Operation::Ope::Read, seven_of_ten_key);
           } else {
-              // ope = new (MemoryAllocator::allocate(sizeof(Operation)))
-              //     Operation(Operation::Ope::Update, key);
-              ope = new Operation(Operation::Ope::Update, seven_of_ten_key);
+              ope = new (MemoryAllocator::allocate(sizeof(Operation)))
+                  Operation(Operation::Ope::Update, seven_of_ten_key);
               w_set_.emplace_back(ope);
           }
           rw_set_.emplace_back(ope);
       }
+
+      set_update_values();
+  }
+
+  // every update writes a distinct value, so the final database depends on
+  // the order of the writers (see CommandLog)
+  void set_update_values() {
+    static uint64_t last_value = 0;  // OperationSets are made by one thread
+    for (Operation *ope : w_set_) ope->value_ = ++last_value;
   }
 
+  // a transaction replayed from the command log
+  explicit OperationSet(const std::vector<LoggedOperation> &ops) {
+    for (const LoggedOperation &logged : ops) {
+      Operation *ope = new (MemoryAllocator::allocate(sizeof(Operation)))
+          Operation(logged.update_ ? Operation::Ope::Update
+                                   : Operation::Ope::Read,
+                    logged.key_);
+      ope->value_ = logged.value_;
+      if (logged.update_) w_set_.emplace_back(ope);
+      rw_set_.emplace_back(ope);
+    }
+  }
+
+  // owns its Operations: moved (when the replay grows its vector), never
+  // copied
+  OperationSet(OperationSet &&) = default;
+
   ~OperationSet() {
     for (uint64_t i = 0; i < rw_set_.size(); i++) {
-      delete rw_set_[i];
+      rw_set_[i]->~Operation();
+      MemoryAllocator::deallocate(rw_set_[i]);
     }
   }
 };
\ No newline at end of file
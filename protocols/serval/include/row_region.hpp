@@ -4,77 +4,61 @@
 
 #include <algorithm> // for find()
 
+#include "protocols/common/epoch_arena.hpp"
 #include "protocols/common/readwritelock.hpp"
+#include "protocols/common/region_pool.hpp"
+#include "protocols/common/version.hpp"
 #include "protocols/serval/include/readwriteset.hpp"
 #include "protocols/ycsb_common/definitions.hpp"
 #include "utils/bitmap.hpp"
 #include "utils/numa.hpp"
+#include "utils/small_sorted_array.hpp"
 
-class Version {
-  public:
-    enum class VersionStatus { PENDING, STABLE }; // status of version
-
-    alignas(64) void *rec = nullptr; // nullptr if deleted = true (immutable)
-    VersionStatus status;
-    bool deleted; // (immutable)
-};
+// records of PAYLOAD_SIZE bytes or less are stored in the version
+using Version = InlineVersion<sizeof(Record)>;
 
 // ascending order
 class GlobalVersionArray {
   public:
-    std::vector<std::pair<int, Version *>> ids_slots_;
-
-    bool is_exist(int tx) {
-        // Use std::find with a custom comparator
-        auto it =
-            std::find_if(ids_slots_.begin(), ids_slots_.end(),
-                         [tx](const auto &pair) { return pair.first == tx; });
-        return it != ids_slots_.end();
-    }
+    static constexpr uint32_t INLINE_SLOTS = 8;
+#if VALUE_SLAB
+    // the 32 bytes of inline ids do not need a line of their own: the
+    // array packs with the header of the row (see Value)
+    SmallSortedArray<int, Version *, INLINE_SLOTS, 32> ids_slots_;
+#else
+    SmallSortedArray<int, Version *, INLINE_SLOTS> ids_slots_;
+#endif
+
+    bool is_exist(int tx) { return ids_slots_.contains(tx); }
 
     std::tuple<bool, uint64_t, Version *>
     search_visible_version(int serial_id) {
-        // Handle the case where tx_id is smaller than or equal to the smallest
-        // tx_id in ids_slots_
-        if (ids_slots_.empty() || serial_id <= ids_slots_.begin()->first) {
+        // the number of versions written before serial_id. 0 when
+        // serial_id is smaller than or equal to the smallest id
+        uint32_t pos = ids_slots_.rank(serial_id);
+        if (pos == 0) {
             return {false, 0, nullptr};
         }
 
-        // Find the first element whose tx_id is greater than the given tx_id
-        auto it = std::upper_bound(
-            ids_slots_.begin(), ids_slots_.end(), serial_id,
-            [](int id, const auto &pair) { return id <= pair.first; });
-
-        // Move the iterator back to the previous element
-        --it;
-
         // Return the tx_id and the corresponding Version* object
-        return {true, it->first, it->second};
+        return {true, ids_slots_.id_at(pos - 1),
+                ids_slots_.value_at(pos - 1)};
     }
 
     void append(Version *version, int serial_id) {
         assert(version);
-
-        // Find the position to insert the new element
-        auto it = std::upper_bound(ids_slots_.begin(), ids_slots_.end(),
-                                   std::make_pair(serial_id, nullptr),
-                                   [](const auto &pair, const auto &value) {
-                                       return pair.first < value.first;
-                                   });
-
-        // Insert the new element at the found position
-        ids_slots_.insert(it, std::make_pair(serial_id, version));
+        ids_slots_.insert(serial_id, version);
     }
 
     void minor_gc(Stat &stat) {
-        for (auto &[id, version] : ids_slots_) {
-            [[maybe_unused]] int id_debug = id;
+        for (uint32_t i = 0; i < ids_slots_.size(); i++) {
+            Version *&version = ids_slots_.value_at(i);
             assert(version);
             assert(version->rec);
             assert(version->status == Version::VersionStatus::STABLE);
 
-            delete reinterpret_cast<Record *>(version->rec);
-            delete version;
+            version->deallocate_record();
+            EpochArena::destroy(version);
             stat.increment(Stat::MeasureType::Delete);
             version = nullptr;
         }
@@ -90,8 +74,10 @@ class GlobalVersionArray {
             return {-1, nullptr};
         }
 
-        auto last = ids_slots_.back(); // 最後尾を取得
-        ids_slots_.pop_back();         // 最後尾を削除
+        // 最後尾を取得
+        std::pair<int, Version *> last = {ids_slots_.back_id(),
+                                          ids_slots_.back_value()};
+        ids_slots_.pop_back(); // 最後尾を削除
 
         return last;
     }
@@ -104,22 +90,44 @@ class GlobalVersionArray {
         if (is_empty())
             return {-1, nullptr};
 
-        return ids_slots_.back();
+        return {ids_slots_.back_id(), ids_slots_.back_value()};
     }
 };
 
 class PerCoreVersionArray { // Serval's per-core version array
   public:
     alignas(64) uint64_t transaction_bitmap_ = 0;
+#if INLINE_VERSION_SLOTS
+    // slot index = rank of the tx in transaction_bitmap_ (see get()).
+    // never reallocated, so get() on another core is safe during append.
+    alignas(64) Version *slots_[MAX_SLOTS_OF_PER_CORE_ARRAY] = {};
+    uint64_t num_slots_ = 0;
+
+    uint64_t num_slots() { return num_slots_; }
+    void push_slot(Version *version) { slots_[num_slots_++] = version; }
+    Version *pop_slot() { return slots_[--num_slots_]; }
+    void clear_slots() { num_slots_ = 0; }
+#else
     std::vector<Version *> slots_;
 
+    uint64_t num_slots() { return slots_.size(); }
+    void push_slot(Version *version) { slots_.emplace_back(version); }
+    Version *pop_slot() {
+        Version *last = slots_.back();
+        slots_.pop_back(); // 最後尾を削除
+        return last;
+    }
+    void clear_slots() { slots_.clear(); }
+#endif
+
     void minor_gc(Stat &stat) {
-        for (Version *&version : slots_) {
+        for (uint64_t i = 0; i < num_slots(); i++) {
+            Version *&version = slots_[i];
             assert(version);
             assert(version->rec);
             assert(version->status == Version::VersionStatus::STABLE);
-            delete reinterpret_cast<Record *>(version->rec);
-            delete version;
+            version->deallocate_record();
+            EpochArena::destroy(version);
             stat.increment(Stat::MeasureType::Delete);
             version = nullptr;
         }
@@ -129,7 +137,7 @@ class PerCoreVersionArray { // Serval's per-core version array
         minor_gc(stat);
         __atomic_store_n(&transaction_bitmap_, 0,
                          __ATOMIC_SEQ_CST); // TODO: 再考
-        slots_.clear();
+        clear_slots();
     }
 
     void update_transaction_bitmap(uint64_t tx_id) {
@@ -178,16 +186,15 @@ class PerCoreVersionArray { // Serval's per-core version array
 
     Version *latest() {
         assert(0 < length());
-        assert(length() == (int)slots_.size());
+        assert(length() == (int)num_slots());
         return slots_[length() - 1];
     }
 
     std::pair<int, Version *> pop_latest() {
         assert(0 < length());
-        assert(length() == (int)slots_.size());
+        assert(length() == (int)num_slots());
 
-        Version *last = slots_.back();
-        slots_.pop_back(); // 最後尾を削除
+        Version *last = pop_slot();
 
         return {find_the_largest(transaction_bitmap_), last};
     }
@@ -198,16 +205,12 @@ class PerCoreVersionArray { // Serval's per-core version array
 
         // append
         assert(length() < MAX_SLOTS_OF_PER_CORE_ARRAY);
-        int len = length(); // 0 - 64
-                            // len:          0 1 2 3 ... 64
-                            // append index: 0 1 2 3 ... x
-        [[maybe_unused]] uint64_t debug_len = slots_.size();
-        assert(len == (int)slots_.size());
-        assert(slots_.size() < 64);
-        // slots_[len] = version;
-        slots_.insert(slots_.begin() + len, version);
-        assert(slots_.size() < 64);
-        assert(debug_len + 1 == slots_.size());
+        [[maybe_unused]] int len = length(); // 0 - 64
+                                             // len:          0 1 2 3 ... 64
+                                             // append index: 0 1 2 3 ... x
+        assert(len == (int)num_slots());
+        push_slot(version); // slots_[len] = version;
+        assert(len + 1 == (int)num_slots());
 
         assert(!is_bit_set_at_the_position(transaction_bitmap_, tx_id));
 
@@ -216,24 +219,25 @@ class PerCoreVersionArray { // Serval's per-core version array
 
         assert(is_bit_set_at_the_position(transaction_bitmap_, tx_id));
         assert(len + 1 == length());
-        assert(length() == (int)slots_.size());
+        assert(length() == (int)num_slots());
     }
 };
 
 class RowRegion { // Serval's RowRegion
   public:
-    uint64_t core_bitmap_ = 0;
+    Bitmap<LOGICAL_CORE_SIZE> core_bitmap_;
     PerCoreVersionArray
         *arrays_[LOGICAL_CORE_SIZE]; // TODO: alignas(64) をつけるか検討
+    RowRegion *next_free_ = nullptr; // link of RegionPool's free list
 
     void initialize_core_bitmap() {
-        __atomic_store_n(&core_bitmap_, 0, __ATOMIC_SEQ_CST);
+        core_bitmap_.clear_atomic();
     };
 
     std::tuple<bool, uint64_t, uint64_t> identify_visible_version(uint64_t core,
                                                                   uint64_t tx) {
         auto [second_core, first_core] =
-            find_the_two_largest_among_or_less_than(core_bitmap_, core);
+            core_bitmap_.find_two_largest_among_or_less_than(core);
 
         if (first_core == -1) {
             assert(first_core == -1 && second_core == -1);
@@ -263,23 +267,40 @@ class RowRegion { // Serval's RowRegion
     }
 
     bool is_dirty() {
-        return __atomic_load_n(&core_bitmap_,
-                               __ATOMIC_SEQ_CST) != 0; // TODO: 再考
+        return core_bitmap_.any_atomic(); // TODO: 再考
+    }
+
+    Version *final_state() {
+        int core = core_bitmap_.find_largest();
+        assert(arrays_[core]);
+        return arrays_[core]->latest();
     }
 
     std::pair<int, Version *> pop_final_state() {
-        int core = find_the_largest(core_bitmap_);
+        int core = core_bitmap_.find_largest();
+        assert(arrays_[core]);
         return arrays_[core]->pop_latest();
     }
 
     void gc_and_initialize_tx_bitmap(uint64_t core, Stat &stat) {
-        arrays_[core]->do_gc_and_initialize_tx_bitmap(stat);
+        PerCoreVersionArray *array =
+            __atomic_load_n(&arrays_[core], __ATOMIC_SEQ_CST);
+        if (array) { // nullptr if the core has never written the row
+            array->do_gc_and_initialize_tx_bitmap(stat);
+        }
+    }
+
+    // before returning the region to the pool: no one can reach it anymore
+    void gc_all(Stat &stat) {
+        for (uint64_t core = 0; core < LOGICAL_CORE_SIZE; core++) {
+            gc_and_initialize_tx_bitmap(core, stat);
+        }
+        initialize_core_bitmap();
     }
 
     // for debug
     bool is_first_write(uint64_t core) {
-        uint64_t core_bitmap = __atomic_load_n(&core_bitmap_, __ATOMIC_SEQ_CST);
-        return !is_bit_set_at_the_position(core_bitmap, core);
+        return !core_bitmap_.test_atomic(core);
     }
 
     void append(uint64_t core, Version *version, uint64_t tx, Stat &stat) {
@@ -288,26 +309,21 @@ class RowRegion { // Serval's RowRegion
         /* Update core bitmap if this is the first append in the current epoch.
         Otherwise, core_bitmap_ is already updated.
         */
-        uint64_t core_bitmap = __atomic_load_n(&core_bitmap_, __ATOMIC_SEQ_CST);
-        bool is_first_write = !is_bit_set_at_the_position(core_bitmap, core);
+        bool is_first_write = !core_bitmap_.test_atomic(core);
         if (is_first_write) {
+            materialize_array(core, stat);
             gc_and_initialize_tx_bitmap(core, stat);
-            __atomic_or_fetch(&core_bitmap_,
-                              set_bit_at_the_given_location(core),
-                              __ATOMIC_SEQ_CST); // core 2: 0010 0000 ... 0000
-            assert(is_bit_set_at_the_position(
-                __atomic_load_n(&core_bitmap_, __ATOMIC_SEQ_CST), core));
+            core_bitmap_.set_atomic(core); // core 2: 0010 0000 ... 0000
+            assert(core_bitmap_.test_atomic(core));
         }
-        assert(is_bit_set_at_the_position(
-            __atomic_load_n(&core_bitmap_, __ATOMIC_SEQ_CST), core));
+        assert(core_bitmap_.test_atomic(core));
         arrays_[core]->append(version, tx);
     }
 
+    // per-core arrays are allocated on the first append of each core
     RowRegion() {
-        pid_t tid = gettid(); // fetch the thread's tid
         for (uint64_t core_id = 0; core_id < LOGICAL_CORE_SIZE; core_id++) {
-            Numa numa(tid, core_id); // move to the designated core
-            arrays_[core_id] = new PerCoreVersionArray; // TOOD: あってる？
+            arrays_[core_id] = nullptr;
         }
     }
 
@@ -316,24 +332,41 @@ class RowRegion { // Serval's RowRegion
             delete arrays_[core_id];
         }
     }
+
+  private:
+    /*
+    The array is allocated by the appending thread, so it is placed in the
+    memory of the appending core in the usual case (append in the
+    initialization phase, where core_ == worker id). Installed with CAS
+    because the installer of a region also appends on behalf of other cores
+    (move_global_array_to_row_region).
+    */
+    void materialize_array(uint64_t core, Stat &stat) {
+        if (__atomic_load_n(&arrays_[core], __ATOMIC_SEQ_CST))
+            return;
+        PerCoreVersionArray *expected = nullptr;
+        PerCoreVersionArray *array = new PerCoreVersionArray;
+        if (__atomic_compare_exchange_n(&arrays_[core], &expected, array,
+                                        false, __ATOMIC_SEQ_CST,
+                                        __ATOMIC_SEQ_CST)) {
+            stat.increment(Stat::MeasureType::MaterializedArrays);
+        } else {
+            delete array; // other thread already installed the array
+        }
+    }
 };
 
 class RowRegionController {
   private:
-    RowRegion regions_[NUM_REGIONS];
-    RWLock lock_;
-    uint64_t used_ = 0; // how many regions currently used
+    RegionPool<RowRegion> pool_;
 
   public:
-    RowRegion *fetch_new_region() {
-        lock_.lock();
-        assert(used_ < NUM_REGIONS);
-        if (NUM_REGIONS <= used_) {
-            throw std::runtime_error("NUM_REGIONS <= used_");
-        }
-        RowRegion *region = &regions_[used_]; // TODO: reconsider
-        used_++;
-        lock_.unlock();
-        return region;
+    RowRegion *fetch_new_region(uint64_t core) { return pool_.fetch(core); }
+
+    void release_region(uint64_t core, RowRegion *region, Stat &stat) {
+        region->gc_all(stat);
+        pool_.release(core, region);
     }
+
+    uint64_t num_allocated_regions() { return pool_.num_allocated(); }
 };
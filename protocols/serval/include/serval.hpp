@@ -7,18 +7,21 @@
 #include <unordered_set>
 
 #include "indexes/masstree.hpp"
+#include "protocols/common/epoch_arena.hpp"
+#include "protocols/common/memory_allocator.hpp"
 #include "protocols/common/readwritelock.hpp"
 #include "protocols/common/transaction_id.hpp"
 #include "protocols/serval/include/major_gc.hpp"
 #include "protocols/serval/include/readwriteset.hpp"
 #include "protocols/serval/include/row_region.hpp"
 #include "protocols/serval/include/value.hpp"
+#include "protocols/ycsb_common/record_misc.hpp"
 #include "utils/bitmap.hpp"
 #include "utils/logger.hpp"
 #include "utils/tsc.hpp"
 #include "utils/utils.hpp"
 
-template <typename Index>
+template <typename Index, typename Allocator, typename Layout>
 class Serval {
  public:
   using Key = typename Index::Key;
@@ -26,10 +29,12 @@ class Serval {
   using LeafNode = typename Index::LeafNode;
   using NodeInfo = typename Index::NodeInfo;
 
-  Serval(uint64_t core_id, uint64_t txid, RowRegionController &rrc, Stat &stat,
-         MajorGC &gc)
+  Serval(uint64_t core_id, uint64_t txid, const Layout &layout,
+         RowRegionController &rrc, Stat &stat, MajorGC &gc)
       : core_(core_id),
         serial_id_(txid),
+        layout_(layout),
+        arena_(EpochArena::get_arena<Allocator>()),
         rrc_(rrc),
         stat_(stat),
         major_gc_(gc) {}
@@ -45,8 +50,12 @@ class Serval {
   }
 
   void append_pending_version(TableID table_id, Key key, Version *&pending) {
-    Index &idx = Index::get_index();
+    append_pending_version(table_id, key, find_value(table_id, key), pending);
+  }
 
+  // val: the row of key, looked up beforehand (see resolve_rows)
+  void append_pending_version(TableID table_id, Key key, Value *val,
+                              Version *&pending) {
     tables.insert(table_id);
     std::vector<Key> &w_table = ws.get_table(table_id);
     typename std::vector<Key>::iterator w_iter =
@@ -54,18 +63,6 @@ class Serval {
 
     // Case of not append occur
     if (w_iter == w_table.end()) {
-      Value *val;
-      typename Index::Result res =
-          idx.find(table_id, key, val);  // find corresponding index in masstree
-
-      if (res == Index::Result::NOT_FOUND) {
-        assert(false);
-        throw std::runtime_error(
-            "masstree NOT_FOUND");  // TODO: この場合、どうするかを考える
-        return;
-      }
-
-      // Got value from masstree
       do_append_pending_version(val, pending);
       assert(pending);
 
@@ -80,74 +77,87 @@ class Serval {
   }
 
   const Rec *read(TableID table_id, Key key) {
-    Index &idx = Index::get_index();
-
-    Value *val;
-    typename Index::Result res =
-        idx.find(table_id, key, val);  // find corresponding index in masstree
+    return wait_stable_and_execute_read(search_visible_version(table_id, key));
+  }
 
-    if (res == Index::Result::NOT_FOUND) {
-      assert(false);
-      throw std::runtime_error(
-          "masstree NOT_FOUND");  // TODO: この場合、どうするかを考える
-      return nullptr;
-    }
+  // the version to read; it may still be PENDING (see try_execute_read)
+  Version *search_visible_version(TableID table_id, Key key) {
+    return search_visible_version(find_value(table_id, key));
+  }
 
+  // val: the row to read, looked up beforehand (see resolve_rows)
+  Version *search_visible_version(Value *val) {
+    assert(val);
     Version *visible = nullptr;
+    RowState &state = val->visible_state(epoch_);
 
     // any append is not executed in the row in the current epoch
-    // and read the final state in one previous epoch
-    uint64_t epoch = val->epoch_;
+    // and read the final state of the last epoch in which it was
+    uint64_t epoch = state.epoch_;
     if (epoch != epoch_) {
-      visible = val->master_;
-      return execute_read(visible);
+      visible = state.final_state();
+      return visible;
     }
 
     assert(epoch == epoch_);
 
-    if (val->global_array_.is_dirty()) {
+    if (state.global_array_.is_dirty()) {
       auto [is_found, txid, v] =
-          val->global_array_.search_visible_version(serial_id_);
+          state.global_array_.search_visible_version(serial_id_);
 
       if (is_found) {
         assert((uint64_t)txid < serial_id_);
         visible = v;
-        return wait_stable_and_execute_read(visible);
+        return visible;
       } else {
         // visible version not found in global array
-        visible = val->master_;
-        return execute_read(visible);
+        visible = state.master_;
+        return visible;
       }
 
-    } else if (val->has_dirty_region()) {
-      auto [is_found, core, tx] = val->row_region_->identify_visible_version(
+    } else if (state.has_dirty_region()) {
+      auto [is_found, core, tx] = state.row_region_->identify_visible_version(
           core_, get_tx_serial(serial_id_));
 
       if (is_found) {
-        assert((core * 64 + tx) < serial_id_);
-        visible = val->row_region_->arrays_[core]->get(tx);
-        return wait_stable_and_execute_read(visible);
+        assert(layout_.serial_id(core, tx) < serial_id_);
+        visible = state.row_region_->arrays_[core]->get(tx);
+        return visible;
       } else {
         // visible version not found in per core version array
-        visible = val->master_;
-        return execute_read(visible);
+        visible = state.master_;
+        return visible;
       }
     }
 
     // initialized by major gc and no write occur in the epoch
-    visible = val->master_;
+    visible = state.master_;
+    return visible;
+  }
+
+  // nullptr while the visible version is still PENDING: the caller can run
+  // another transaction and retry later instead of spinning
+  const Rec *try_execute_read(Version *visible) {
+    assert(visible);
+    if (__atomic_load_n(&visible->status, __ATOMIC_SEQ_CST) ==
+        Version::VersionStatus::PENDING) {
+      return nullptr;
+    }
     return execute_read(visible);
   }
 
-  Rec *write(TableID table_id, Version *pending) {
-    return upsert(table_id, pending);
+  // value: of the update (see write_value())
+  Rec *write(TableID table_id, Version *pending, uint64_t value) {
+    return upsert(table_id, pending, value);
   }
 
-  Rec *upsert(TableID table_id, Version *pending) {
+  Rec *upsert(TableID table_id, Version *pending, uint64_t value) {
     const Schema &sch = Schema::get_schema();
     size_t record_size = sch.get_record_size(table_id);
 
-    Rec *rec = reinterpret_cast<Rec *>(operator new(record_size));
+    Rec *rec =
+        reinterpret_cast<Rec *>(pending->allocate_record(arena_, record_size));
+    write_value(rec, record_size, value);  // before the version is STABLE
     __atomic_store_n(&pending->rec, rec, __ATOMIC_SEQ_CST);  // write
     __atomic_store_n(&pending->status, Version::VersionStatus::STABLE,
                      __ATOMIC_SEQ_CST);
@@ -155,9 +165,39 @@ class Serval {
     return rec;
   }
 
+  /*
+  initialization phase, after the appends of the core: the rows in which
+  the core installed a region and that were not written for
+  NUM_LIVE_EPOCHS epochs are initialized as a write of this epoch would,
+  which moves their final state to the master and gives their regions
+  back to the pool (see Value::initialize_the_row). Otherwise a row that
+  stays cold keeps its region forever.
+  */
+  void release_cold_regions() {
+    auto itr = rows_with_region_.begin();
+    while (itr != rows_with_region_.end()) {
+      Value *val = *itr;
+      if (val->epoch() + NUM_LIVE_EPOCHS < epoch_) {
+        val->lock();
+        if (val->epoch() < epoch_) {
+          val->initialize_the_row(epoch_, rrc_, core_, stat_);
+        }
+        val->unlock();
+      }
+
+      if (val->has_region()) {
+        ++itr;  // still hot, or released in a later epoch
+      } else {
+        itr = rows_with_region_.erase(itr);
+      }
+    }
+  }
+
   uint64_t core_;
-  uint64_t serial_id_;  // 0 - 4096
+  uint64_t serial_id_;  // 0 - layout_.txs_per_epoch()
+  const Layout layout_;
   uint64_t epoch_ = 0;
+  EpochArena &arena_;  // versions and records of this core
 
  private:
   WriteSet<Key> ws;  // write set
@@ -165,21 +205,39 @@ class Serval {
 
   RowRegion *spare_region_ = nullptr;
 
+  // the rows in which this core installed a region (release_cold_regions)
+  std::unordered_set<Value *> rows_with_region_;
+
   RowRegionController &rrc_;
 
   Stat &stat_;
 
   MajorGC &major_gc_;
 
+  Value *find_value(TableID table_id, Key key) {
+    Index &idx = Index::get_index();
+    Value *val;
+    typename Index::Result res =
+        idx.find(table_id, key, val);  // find corresponding index in masstree
+
+    if (res == Index::Result::NOT_FOUND) {
+      assert(false);
+      throw std::runtime_error(
+          "masstree NOT_FOUND");  // TODO: この場合、どうするかを考える
+    }
+    return val;
+  }
+
   void do_append_pending_version(Value *val, Version *&pending) {
     assert(!pending);
 
     epoch_guard(val);
 
-    assert(val->epoch_ == epoch_);
+    assert(val->epoch() == epoch_);
     /*
-    val->epoch_ == epoch_
+    val->epoch() == epoch_
     */
+    RowState &state = val->state(epoch_);
 
     // the val is may be uncontented
     if (val->try_lock()) {
@@ -188,11 +246,11 @@ class Serval {
       // the val will or may be contented if the row_region_ is already
       // exist.
       RowRegion *cur_region =
-          __atomic_load_n(&val->row_region_, __ATOMIC_SEQ_CST);
+          __atomic_load_n(&state.row_region_, __ATOMIC_SEQ_CST);
       if (may_be_contented(cur_region)) {
         pending = append_to_contented_row(val, cur_region);
       } else {
-        pending = append_to_unconted_row(val);
+        pending = append_to_unconted_row(val, state);
       }
 
       val->unlock();
@@ -200,26 +258,27 @@ class Serval {
     }
 
     // couldn't acquire the lock: the val is getting crowded.
-    RowRegion *region = wait_region_installation(val);
+    RowRegion *region = wait_region_installation(val, state);
     assert(region);
     pending = append_to_contented_row(val, region);
     return;
   }
 
-  RowRegion *wait_region_installation(Value *val) {
+  RowRegion *wait_region_installation(Value *val, RowState &state) {
     RowRegion *region;
     uint64_t start = rdtscp();
-    while (!(region = __atomic_load_n(&val->row_region_, __ATOMIC_SEQ_CST))) {
+    while (!(region = __atomic_load_n(&state.row_region_, __ATOMIC_SEQ_CST))) {
       if (val->try_lock()) {
         stat_.add(Stat::MeasureType::WaitInInitialization, rdtscp() - start);
         // region_を設置する権限を得る。他のスレッドは、region_が設置されるまで待機
-        region = __atomic_load_n(&val->row_region_, __ATOMIC_SEQ_CST);
+        region = __atomic_load_n(&state.row_region_, __ATOMIC_SEQ_CST);
         if (!region) {
-          assert(!__atomic_load_n(&val->row_region_, __ATOMIC_SEQ_CST));
-          region = rrc_.fetch_new_region();
-          move_global_array_to_row_region(val->global_array_, region);
+          assert(!__atomic_load_n(&state.row_region_, __ATOMIC_SEQ_CST));
+          region = rrc_.fetch_new_region(core_);
+          move_global_array_to_row_region(state.global_array_, region);
+          rows_with_region_.insert(val);
           __atomic_store_n(
-              &val->row_region_, region,
+              &state.row_region_, region,
               __ATOMIC_SEQ_CST);  // これした時点でunlockする前に、他のスレッドは、regionに触る可能性がある
         }  // else: other thread already install region
         val->unlock();
@@ -230,30 +289,32 @@ class Serval {
     return region;  // other thread already install region
   }
 
-  uint64_t get_core_serial(uint64_t serial_id) { return serial_id / 64; }
-  uint64_t get_tx_serial(uint64_t serial_id) { return serial_id % 64; }
+  uint64_t get_core_serial(uint64_t serial_id) {
+    return layout_.core(serial_id);
+  }
+  uint64_t get_tx_serial(uint64_t serial_id) { return layout_.tx(serial_id); }
   std::pair<uint64_t, uint64_t> decompose_id_serial(uint64_t serial_id) {
     return {get_core_serial(serial_id), get_tx_serial(serial_id)};
   }
 
   void move_global_array_to_row_region(GlobalVersionArray &g_array,
                                        RowRegion *region) {
-    for (auto [serial_id, version] : g_array.ids_slots_) {
-      auto [core, tx] = decompose_id_serial(serial_id);
-      region->append(core, version, tx, stat_);
+    for (uint32_t i = 0; i < g_array.ids_slots_.size(); i++) {
+      auto [core, tx] = decompose_id_serial(g_array.ids_slots_.id_at(i));
+      region->append(core, g_array.ids_slots_.value_at(i), tx, stat_);
     }
     g_array.ids_slots_.clear();
   }
 
   void epoch_guard(Value *val) {
     uint64_t start = rdtscp();
-    while (__atomic_load_n(&val->epoch_, __ATOMIC_SEQ_CST) < epoch_) {
+    while (val->epoch() < epoch_) {
       if (val->try_lock()) {
         stat_.add(Stat::MeasureType::WaitInInitialization, rdtscp() - start);
-        if (__atomic_load_n(&val->epoch_, __ATOMIC_SEQ_CST) < epoch_) {
+        if (val->epoch() < epoch_) {
           // the first transaction in the current epoch to arrive on
           // the val
-          val->initialize_the_row(epoch_, stat_);
+          val->initialize_the_row(epoch_, rrc_, core_, stat_);
         }
         val->unlock();
         return;
@@ -280,12 +341,12 @@ class Serval {
   }
 
   // lock should be acuired before this function is called
-  Version *append_to_unconted_row(Value *val) {
+  Version *append_to_unconted_row(Value *val, RowState &state) {
     Version *new_version = create_pending_version(val);
 
     // Append pending version to global version chain
-    val->global_array_.append(new_version, serial_id_);
-    assert(val->global_array_.is_exist(serial_id_));
+    state.global_array_.append(new_version, serial_id_);
+    assert(state.global_array_.is_exist(serial_id_));
 
     return new_version;
   }
@@ -303,9 +364,7 @@ class Serval {
   }
 
   Version *create_pending_version([[maybe_unused]] Value *val) {
-    // Version *version = reinterpret_cast<Version *>(
-    //     MemoryAllocator::aligned_allocate(sizeof(Version)));
-    Version *version = new Version;
+    Version *version = arena_.create<Version>();
     version->rec = nullptr;  // TODO
     version->deleted = false;
     version->status = Version::VersionStatus::PENDING;
@@ -3,21 +3,28 @@
 #include <cstdint>
 #include <mutex>
 
+#include "protocols/common/epoch_arena.hpp"
 #include "protocols/common/readwritelock.hpp"
 #include "protocols/serval/include/row_region.hpp"
+#include "protocols/ycsb_common/definitions.hpp"
 #include "utils/atomic_wrapper.hpp"
 
-struct Value {
-    alignas(64) RWLock rwl;
+/*
+  The versions of a row appended in one epoch.
+
+  The fields every access reads (epoch_, master_ and row_region_) come
+  first, so they share a line.
+*/
+struct RowState {
     uint64_t epoch_ = 0;
 
-    Version *master_ = nullptr; // final state
-
-    GlobalVersionArray global_array_; // Global Version Array
+    Version *master_ = nullptr; // final state of the previous epoch
 
     // For contended versions
     RowRegion *row_region_ = nullptr; // Pointer to per-core version array
 
+    GlobalVersionArray global_array_; // Global Version Array
+
     bool has_dirty_region() {
         if (__atomic_load_n(&row_region_, __ATOMIC_SEQ_CST)) { // TODO: 再考
             return row_region_->is_dirty();
@@ -25,6 +32,61 @@ struct Value {
         return false;
     }
 
+    // the last version appended in the epoch, master_ if there is none
+    Version *final_state() {
+        assert(!(global_array_.is_dirty() && has_dirty_region()));
+        if (global_array_.is_dirty()) {
+            return global_array_.latest().second;
+        } else if (has_dirty_region()) {
+            return row_region_->final_state();
+        }
+        return master_;
+    }
+
+    // frees all the versions of the state but keep
+    void gc(Version *keep, Stat &stat) {
+        assert(!(global_array_.is_dirty() && has_dirty_region()));
+        if (global_array_.is_dirty()) {
+            assert(!has_dirty_region());
+            if (global_array_.latest().second == keep) {
+                global_array_.pop_final_state();
+            }
+            global_array_.gc(stat);
+        } else if (has_dirty_region()) {
+            assert(!global_array_.is_dirty());
+            if (row_region_->final_state() == keep) {
+                row_region_->pop_final_state();
+            }
+            row_region_->initialize_core_bitmap(); // initialize
+        }
+
+        if (master_ && master_ != keep) {
+            assert(master_->rec);
+            master_->deallocate_record();
+            EpochArena::destroy(master_);
+            stat.increment(Stat::MeasureType::Delete);
+        }
+        master_ = nullptr;
+    }
+};
+
+/*
+  A row keeps the states of the last NUM_LIVE_EPOCHS epochs in which it was
+  written. With one state (the default), the state is reinitialized by the
+  first append of each epoch. With two (PIPELINED_EPOCHS), the
+  initialization phase of epoch N + 1 reinitializes the older state while
+  the execution phase of epoch N may still read the other one.
+
+  With VALUE_SLAB, the global version array is only aligned to 32 bytes,
+  so the first state starts in the line of the lock: the lock, the epoch,
+  the master and the region of the row are one line, and a Value is three
+  lines instead of five.
+*/
+struct Value {
+    alignas(64) RWLock rwl;
+
+    RowState states_[NUM_LIVE_EPOCHS];
+
     void initialize() { rwl.initialize(); }
 
     void lock() { rwl.lock(); }
@@ -33,41 +95,102 @@ struct Value {
 
     void unlock() { rwl.unlock(); }
 
-    void gc_master_version(Version *latest, Stat &stat) {
-        assert(master_);
-        assert(master_->rec);
-        delete reinterpret_cast<Record *>(master_->rec);
-        delete master_;
-        stat.increment(Stat::MeasureType::Delete);
-        master_ = latest;
+    // the last epoch in which the row was initialized
+    uint64_t epoch() { return latest_state().epoch_; }
+
+    RowState &latest_state() {
+        RowState *latest = &states_[0];
+        for (RowState &state : states_) {
+            if (__atomic_load_n(&latest->epoch_, __ATOMIC_SEQ_CST) <
+                __atomic_load_n(&state.epoch_, __ATOMIC_SEQ_CST)) {
+                latest = &state;
+            }
+        }
+        return *latest;
+    }
+
+    // whether a state still holds a region
+    bool has_region() {
+        for (RowState &state : states_) {
+            if (__atomic_load_n(&state.row_region_, __ATOMIC_SEQ_CST)) {
+                return true;
+            }
+        }
+        return false;
     }
 
-    void initialize_the_row(uint64_t epoch, Stat &stat) {
+    // the state that the initialization phase of epoch fills
+    RowState &state(uint64_t epoch) {
+        for (RowState &state : states_) {
+            if (__atomic_load_n(&state.epoch_, __ATOMIC_SEQ_CST) == epoch) {
+                return state;
+            }
+        }
+        assert(false);
+        return states_[0];
+    }
+
+    // the state that the transactions of epoch read: the latest one that
+    // is not newer than epoch
+    RowState &visible_state(uint64_t epoch) {
+        RowState *visible = nullptr;
+        uint64_t visible_epoch = 0;
+        for (RowState &state : states_) {
+            uint64_t e = __atomic_load_n(&state.epoch_, __ATOMIC_SEQ_CST);
+            if (e <= epoch && (!visible || visible_epoch < e)) {
+                visible = &state;
+                visible_epoch = e;
+            }
+        }
+        assert(visible);
+        return *visible;
+    }
+
+    void initialize_the_row(uint64_t epoch, RowRegionController &rrc,
+                            uint64_t core, Stat &stat) {
         /*
         [!global_array_.is_dirty() && !has_dirty_region()]
         epoch 7: major gc (initialize_the_row)
         epoch 10: initialization phase (initialize_the_row)
         */
-        assert(!(global_array_.is_dirty() && has_dirty_region()));
+        RowState &latest = latest_state();
+        RowState &target = oldest_state(); // == latest with one state
+        assert(latest.epoch_ < epoch);
 
-        // 1. store the final state of one previous epoch to val->master_
-        if (global_array_.is_dirty()) {
-            assert(!has_dirty_region());
-            auto [id, latest] = global_array_.pop_final_state();
-            assert(latest);
-            global_array_.gc(stat);
-            gc_master_version(latest, stat);
-        } else if (has_dirty_region()) {
-            assert(!global_array_.is_dirty());
-            auto [id, latest] = row_region_->pop_final_state();
-            assert(latest);
-            row_region_->initialize_core_bitmap(); // initialize
-            gc_master_version(latest, stat);
+        // 1. the final state of the latest epoch is the master of this one
+        Version *master = latest.final_state();
+        assert(master);
+
+        // 2. collect the target. it is not visible to anyone anymore, except
+        // for its final state (or master) if that is the master of latest
+        target.gc(&target == &latest ? master : latest.master_, stat);
+
+        // 3. give the region back to the pool if the row went cold, i.e. the
+        // state was not used in the previous round. The remaining versions
+        // of the region are not visible to anyone in this epoch. A row that
+        // stays cold is not written again: Serval::release_cold_regions()
+        // initializes it instead.
+        if (target.row_region_ && target.epoch_ + NUM_LIVE_EPOCHS < epoch) {
+            RowRegion *region = target.row_region_;
+            __atomic_store_n(&target.row_region_, nullptr, __ATOMIC_SEQ_CST);
+            rrc.release_region(core, region, stat);
         }
 
-        // 2. update val->epoch_
+        // 4. update the epoch of the state
+        target.master_ = master;
         asm volatile("" : : : "memory");
-        __atomic_store_n(&epoch_, epoch, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&target.epoch_, epoch, __ATOMIC_SEQ_CST);
         asm volatile("" : : : "memory");
     }
+
+  private:
+    RowState &oldest_state() {
+        RowState *oldest = &states_[NUM_LIVE_EPOCHS - 1];
+        for (RowState &state : states_) {
+            if (state.epoch_ < oldest->epoch_) {
+                oldest = &state;
+            }
+        }
+        return *oldest;
+    }
 };
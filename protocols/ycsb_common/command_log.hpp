@@ -0,0 +1,225 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+  Epoch-granular command log (COMMAND_LOG).
+
+  The protocols are deterministic: the database after epoch N only depends
+  on the database after epoch N - 1 and the batch of transactions of epoch
+  N, in serial id order. So logging the input batch of every epoch before
+  it executes is enough to rebuild the committed state; no record or
+  version is logged.
+
+  A dedicated logger thread serializes the batch of epoch N, writes it with
+  one pwritev() and makes it durable with one fdatasync() (group commit of
+  the whole epoch). The batch of epoch N + 1 becomes available when epoch N
+  starts to execute (begin_execution()), so logging epoch N + 1 overlaps the
+  execution of epoch N, and the workers only wait (wait_durable()) when the
+  log is slower than an epoch.
+
+      [EpochHeader | tx 0 | tx 1 | ... ]  for epoch 1, 2, ...
+      tx: [#operations | key (| UPDATE_BIT) | value | key | value | ...]
+
+  All the words are uint64_t in host byte order.
+
+  A crash leaves at most one torn epoch at the end of the log; read() stops
+  there, as that epoch never executed.
+*/
+
+// an operation of a logged transaction
+struct LoggedOperation {
+    bool update_;
+    uint64_t key_;
+    uint64_t value_;
+};
+
+template <typename OperationSet> class CommandLog {
+  public:
+    static constexpr uint64_t MAGIC = 0x474f4c444d4d4f43; // "COMMDLOG"
+    static constexpr uint64_t UPDATE_BIT = 1ULL << 63;
+
+    struct EpochHeader {
+        uint64_t magic_;
+        uint64_t epoch_;
+        uint64_t num_txs_;
+        uint64_t size_;     // bytes of the batch after the header
+        uint64_t checksum_; // of the batch (see checksum())
+        uint64_t pad_[3];
+    };
+    static_assert(sizeof(EpochHeader) == 64);
+
+    static uint64_t checksum(const uint64_t *words, size_t n) {
+        uint64_t h = 0xcbf29ce484222325; // FNV-1a, word by word
+        for (size_t i = 0; i < n; i++) {
+            h = (h ^ words[i]) * 0x100000001b3;
+        }
+        return h;
+    }
+
+    // truncates the log at path and starts logging num_epochs epochs of
+    // txs_per_epoch transactions of txs
+    CommandLog(const std::string &path, const std::vector<OperationSet> &txs,
+               uint64_t txs_per_epoch, uint64_t num_epochs)
+        : txs_(txs), txs_per_epoch_(txs_per_epoch), num_epochs_(num_epochs) {
+        fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd_ == -1)
+            throw std::runtime_error("cannot open command log " + path + ": " +
+                                     strerror(errno));
+        logger_ = std::thread([this] { run(); });
+    }
+
+    ~CommandLog() {
+        logger_.join();
+        close(fd_);
+    }
+
+    CommandLog(const CommandLog &) = delete;
+    CommandLog &operator=(const CommandLog &) = delete;
+
+    // epoch starts to execute: the batch of epoch + 1 can be logged
+    void begin_execution(uint64_t epoch) {
+        executing_epoch_.store(epoch, std::memory_order_release);
+    }
+
+    // returns when the batch of epoch is durable
+    void wait_durable(uint64_t epoch) const {
+        while (durable_epoch_.load(std::memory_order_acquire) < epoch) {
+            asm volatile("pause" : : : "memory"); // equivalent to "rep; nop"
+        }
+    }
+
+    uint64_t bytes_written() const { return offset_; }
+
+    // appends the transactions of the complete epochs of the log at path to
+    // txs, in serial id order, and returns the number of these epochs
+    static uint64_t read(const std::string &path, uint64_t txs_per_epoch,
+                         std::vector<OperationSet> &txs) {
+        FILE *file = fopen(path.c_str(), "rb");
+        if (!file)
+            throw std::runtime_error("cannot open command log " + path);
+
+        uint64_t epoch = 0;
+        EpochHeader header;
+        std::vector<uint64_t> batch;
+        std::vector<LoggedOperation> ops;
+        while (fread(&header, sizeof(header), 1, file) == 1) {
+            if (header.magic_ != MAGIC || header.epoch_ != epoch + 1)
+                break;
+            if (header.num_txs_ != txs_per_epoch) {
+                fclose(file);
+                throw std::runtime_error(
+                    "command log " + path +
+                    " has another number of transactions per epoch");
+            }
+            batch.resize(header.size_ / sizeof(uint64_t));
+            if (fread(batch.data(), sizeof(uint64_t), batch.size(), file) !=
+                    batch.size() ||
+                checksum(batch.data(), batch.size()) != header.checksum_)
+                break; // torn
+
+            const uint64_t *word = batch.data();
+            for (uint64_t i = 0; i < txs_per_epoch; i++) {
+                ops.resize(*word++);
+                for (LoggedOperation &ope : ops) {
+                    ope.update_ = word[0] & UPDATE_BIT;
+                    ope.key_ = word[0] & ~UPDATE_BIT;
+                    ope.value_ = word[1];
+                    word += 2;
+                }
+                txs.emplace_back(ops);
+            }
+            epoch++;
+        }
+        fclose(file);
+        return epoch;
+    }
+
+  private:
+    const std::vector<OperationSet> &txs_;
+    uint64_t txs_per_epoch_;
+    uint64_t num_epochs_;
+
+    int fd_;
+    off_t offset_ = 0;
+    std::vector<uint64_t> batch_;
+    std::thread logger_;
+
+    alignas(64) std::atomic<uint64_t> executing_epoch_{0};
+    alignas(64) std::atomic<uint64_t> durable_epoch_{0};
+
+    void run() {
+        for (uint64_t epoch = 1; epoch <= num_epochs_; epoch++) {
+            while (executing_epoch_.load(std::memory_order_acquire) + 1 <
+                   epoch) {
+                std::this_thread::yield(); // the batch has not arrived yet
+            }
+            serialize(epoch);
+            write_batch(epoch);
+            if (fdatasync(fd_) != 0)
+                throw std::runtime_error(std::string("fdatasync: ") +
+                                         strerror(errno));
+            durable_epoch_.store(epoch, std::memory_order_release);
+        }
+    }
+
+    void serialize(uint64_t epoch) {
+        batch_.clear();
+        uint64_t head = (epoch - 1) * txs_per_epoch_;
+        for (uint64_t i = head; i < head + txs_per_epoch_; i++) {
+            const auto &rw_set = txs_[i].rw_set_;
+            batch_.emplace_back(rw_set.size());
+            for (const auto *ope : rw_set) {
+                bool update = ope->ope_ == ope->Update;
+                batch_.emplace_back(ope->index_ | (update ? UPDATE_BIT : 0));
+                batch_.emplace_back(ope->value_);
+            }
+        }
+    }
+
+    void write_batch(uint64_t epoch) {
+        EpochHeader header = {};
+        header.magic_ = MAGIC;
+        header.epoch_ = epoch;
+        header.num_txs_ = txs_per_epoch_;
+        header.size_ = batch_.size() * sizeof(uint64_t);
+        header.checksum_ = checksum(batch_.data(), batch_.size());
+
+        struct iovec iov[2] = {{&header, sizeof(header)},
+                               {batch_.data(), header.size_}};
+        struct iovec *next = iov;
+        int count = 2;
+        while (0 < count) {
+            ssize_t n = pwritev(fd_, next, count, offset_);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                throw std::runtime_error(std::string("pwritev: ") +
+                                         strerror(errno));
+            }
+            offset_ += n;
+            // skip what is written (short write)
+            while (0 < count && static_cast<size_t>(n) >= next->iov_len) {
+                n -= next->iov_len;
+                next++;
+                count--;
+            }
+            if (0 < count) {
+                next->iov_base = static_cast<char *>(next->iov_base) + n;
+                next->iov_len -= n;
+            }
+        }
+    }
+};
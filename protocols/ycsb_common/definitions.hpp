@@ -7,15 +7,10 @@ using Record = Payload<PAYLOAD_SIZE>;
 using Record = Payload<PAYLOAD_SIZE>;
 #endif
 
-#define NUM_CORE 64
-
-#define NUM_TXS_IN_ONE_EPOCH_IN_ONE_CORE \
-  (NUM_TXS_IN_ONE_EPOCH / NUM_CORE)  // the number of transactions in one epoch
-
 // #define NUM_TXS_IN_ONE_EPOCH 4096 // the number of transactions in one epoch
-#define NUM_ALL_TXS (NUM_TXS_IN_ONE_EPOCH * NUM_EPOCH)
-// #define NUM_ALL_TXS (4096 * 10)
-// total number of transactions executed in the exeperiment
+// the number of cores and of transactions per core are given at runtime
+// (see SerialIdLayout); NUM_TXS_IN_ONE_EPOCH only sets the default of the
+// latter
 
 // change NUM_EPOCH for experiments
 #define NUM_EPOCH 1000  // 1000
@@ -24,7 +19,22 @@ using Record = Payload<PAYLOAD_SIZE>;
 #define CLOCKS_PER_MS (CLOCKS_PER_US * 1000)
 #define CLOCKS_PER_S (CLOCKS_PER_MS * 1000)
 
-#define NUM_REGIONS 10000  // Caracal's definition is 256, use 10000 here
-// #define NUM_REGIONS 1000 // Caracal's definition is 256, use 10000 here
 
 #define MAX_SLOTS_OF_PER_CORE_ARRAY 64  // for Serval
+
+// the number of epochs whose versions can be read at the same time: 2 when
+// the initialization phase of epoch N + 1 overlaps the execution phase of
+// epoch N (PIPELINED_EPOCHS)
+#define NUM_LIVE_EPOCHS (PIPELINED_EPOCHS ? 2 : 1)
+
+// 1: the Values of a table are allocated in one key-ordered slab, with the
+// compacted row layout (see ValueSlab); set by CMake
+#ifndef VALUE_SLAB
+#define VALUE_SLAB 0
+#endif
+
+// 1: the batch of every epoch is made durable in the command log before it
+// executes (see CommandLog); set by CMake
+#ifndef COMMAND_LOG
+#define COMMAND_LOG 0
+#endif
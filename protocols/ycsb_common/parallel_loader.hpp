@@ -0,0 +1,43 @@
+#pragma once
+
+#include <unistd.h> // for gettid()
+
+#include <cassert>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "utils/numa.hpp"
+
+/*
+  Loads the keys [0, num_keys) of a table with num_threads loader threads.
+
+  Loader t is pinned to cpu t, the cpu of worker t (see Numa), and calls
+  load(key) for the t-th contiguous range of the keys. Everything it
+  allocates (Values, versions and records from its own arena, index
+  nodes) comes from, or is first touched on, the NUMA node of that cpu, so
+  the table is partitioned by key range over the nodes of the workers
+  instead of living on node 0.
+
+  load() runs concurrently on all the loaders: the index must already have
+  the table (create_table()).
+*/
+template <typename F>
+void parallel_load(uint64_t num_keys, uint64_t num_threads, const F &load) {
+    assert(0 < num_threads && num_threads <= LOGICAL_CORE_SIZE);
+    std::vector<std::thread> loaders;
+    loaders.reserve(num_threads);
+    for (uint64_t t = 0; t < num_threads; t++) {
+        uint64_t begin = num_keys * t / num_threads;
+        uint64_t end = num_keys * (t + 1) / num_threads;
+        loaders.emplace_back([&load, t, begin, end] {
+            Numa numa(gettid(), t); // move to the designated core
+            for (uint64_t key = begin; key < end; key++) {
+                load(key);
+            }
+        });
+    }
+    for (auto &loader : loaders) {
+        loader.join();
+    }
+}
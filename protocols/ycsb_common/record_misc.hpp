@@ -1,5 +1,9 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
 #include "benchmarks/ycsb/include/record_key.hpp"
 #include "benchmarks/ycsb/include/record_layout.hpp"
 #include "protocols/common/schema.hpp"
@@ -8,3 +12,12 @@ template <typename Record>
 inline TableID get_id() {
     return sizeof(Record);
 }
+
+// initializes the new record of an update, of record_size bytes: the value
+// of the update in its first bytes (the payload of a YCSB record is opaque
+// otherwise) and zeros after them, as a loaded record. A replay of the
+// command log thus rebuilds the same bytes
+inline void write_value(void *rec, size_t record_size, uint64_t value) {
+    memset(rec, 0, record_size);
+    memcpy(rec, &value, std::min(record_size, sizeof(value)));
+}
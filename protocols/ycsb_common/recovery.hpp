@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "benchmarks/ycsb/include/config.hpp"
+
+/*
+  Recovery from the command log (see CommandLog).
+
+  The database is rebuilt from its checkpoint, the snapshot of the load
+  (see Snapshot), and the logged epochs are replayed in order through the
+  normal initialization and execution phases, with all the workers: the
+  protocols are deterministic, so the replay reaches the state of the
+  crashed run without executing any transaction serially.
+
+  To check a replay, a run with COMMAND_LOG stores the hash of its final
+  database next to its log (hash_path()); the replay of all the epochs of
+  the log must reach the same hash.
+*/
+
+// hash of the table, record_of(key) giving the record of each key
+template <typename RecordOf>
+uint64_t database_hash(uint64_t num_records, size_t record_size,
+                       const RecordOf &record_of) {
+    uint64_t h = 0xcbf29ce484222325; // FNV-1a
+    for (uint64_t key = 0; key < num_records; key++) {
+        const unsigned char *rec =
+            static_cast<const unsigned char *>(record_of(key));
+        for (size_t i = 0; i < record_size; i++) {
+            h = (h ^ rec[i]) * 0x100000001b3;
+        }
+    }
+    return h;
+}
+
+inline std::string hash_path(const std::string &log_path) {
+    return log_path + ".hash";
+}
+
+// the hash of the database after num_epochs epochs
+inline void store_hash(const std::string &log_path, uint64_t num_epochs,
+                       uint64_t hash) {
+    FILE *file = fopen(hash_path(log_path).c_str(), "w");
+    if (!file)
+        return; // the log stays usable, without a check
+    fprintf(file, "%" PRIu64 " %016" PRIx64 "\n", num_epochs, hash);
+    fclose(file);
+}
+
+// false if the run of the log did not store a hash
+inline bool load_hash(const std::string &log_path, uint64_t &num_epochs,
+                      uint64_t &hash) {
+    FILE *file = fopen(hash_path(log_path).c_str(), "r");
+    if (!file)
+        return false;
+    bool ok =
+        fscanf(file, "%" SCNu64 " %" SCNx64, &num_epochs, &hash) == 2;
+    fclose(file);
+    return ok;
+}
+
+/*
+  After the last epoch of a run, with record_of(key) giving the committed
+  record of each key: stores the hash of the database next to the command
+  log of the run if store, or checks it against the stored one after a
+  replay. Returns false if the replay did not reach the stored state.
+*/
+template <typename RecordOf>
+bool store_or_check_hash(const Config &c, bool store, uint64_t num_epochs,
+                         size_t record_size, const RecordOf &record_of) {
+    if (!store && !c.is_recovery())
+        return true;
+    uint64_t hash = database_hash(c.get_num_records(), record_size, record_of);
+    printf("Database hash after %" PRIu64 " epoch(s): %016" PRIx64 "\n",
+           num_epochs, hash);
+    if (!c.is_recovery()) {
+        store_hash(c.get_log_path(), num_epochs, hash);
+        return true;
+    }
+
+    uint64_t expected_epochs, expected;
+    if (!load_hash(c.get_recovery_log_path(), expected_epochs, expected) ||
+        expected_epochs != num_epochs) {
+        // the run crashed: nothing to compare with
+        printf("No hash after %" PRIu64 " epoch(s) to check\n", num_epochs);
+        return true;
+    }
+    bool ok = hash == expected;
+    printf("Recovered state %s the one before the crash (%016" PRIx64 ")\n",
+           ok ? "matches" : "DOES NOT match", expected);
+    return ok;
+}
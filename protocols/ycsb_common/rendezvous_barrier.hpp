@@ -1,5 +1,23 @@
 #pragma once
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "utils/numa.hpp"
+
+/*
+  A node of the combining tree of RendezvousBarrier.
+
+  The threads (or child nodes) of a node decrement ready_; the last one to
+  arrive goes on to the parent, and later releases the node by writing the
+  number of the round to start_. Everyone else spins on start_ of the node
+  it stopped at, so a release only invalidates lines shared by a few cores
+  of the same NUMA node.
+*/
 class RendezvousBarrierVariable {
   public:
     enum BarrierType : int {
@@ -11,64 +29,128 @@ class RendezvousBarrierVariable {
         Size
     };
 
-    alignas(64)
-        BarrierType start_ = BarrierType::BeforeExp; // parent to children
-    alignas(64) int ready_; // children to parent: decremented when the thread
-                            // is ready
-
+    alignas(64) int ready_; // decremented when a child arrives
     int num_children_;
+    RendezvousBarrierVariable *parent_ = nullptr; // nullptr for the root
+
+    alignas(64) uint64_t start_ = 0; // the last round released
+    BarrierType type_ = BarrierType::BeforeExp; // of that round
 
     RendezvousBarrierVariable(int num_children)
         : ready_(num_children), num_children_(num_children) {}
 
-    // called from parent
-    void wait_all_children_ready() {
-        while (0 < __atomic_load_n(&ready_, __ATOMIC_SEQ_CST)) {
-            // spin
-            asm volatile("pause" : : : "memory"); // equivalent to "rep; nop"
-        }
-    }
-    // called from parent
-    void send_start_to_all_children(BarrierType type) {
-        __atomic_store_n(&start_, type, __ATOMIC_SEQ_CST);
-    }
-    // called from parent
-    void initialize() {
+    // true for the last child to arrive
+    bool arrive() {
+        if (__atomic_sub_fetch(&ready_, 1, __ATOMIC_SEQ_CST) != 0)
+            return false;
+        // nobody can arrive again before the node is released
         __atomic_store_n(&ready_, num_children_, __ATOMIC_SEQ_CST);
+        return true;
     }
 
-    // called from children
-    void send_ready_to_parent() {
-        __atomic_sub_fetch(&ready_, 1, __ATOMIC_SEQ_CST);
-    }
-    // called from children
-    void wait_start(BarrierType type) {
-        while (__atomic_load_n(&start_, __ATOMIC_SEQ_CST) != type) {
+    void wait_start(uint64_t round) {
+        while (__atomic_load_n(&start_, __ATOMIC_SEQ_CST) != round) {
             // spin
             asm volatile("pause" : : : "memory"); // equivalent to "rep; nop"
         }
     }
+
+    void send_start(uint64_t round, BarrierType type) {
+        type_ = type;
+        __atomic_store_n(&start_, round, __ATOMIC_SEQ_CST);
+    }
 };
 
+/*
+  NUMA-aware combining-tree barrier.
+
+  Leaves hold up to FAN_IN threads of the same NUMA node, the leaves of a
+  node are combined by a per-node variable, and the nodes by the root. The
+  thread that arrives last at the root plays the parent of the round, so
+  no thread is fixed as the parent.
+
+  Worker i is expected to run on cpu i (see Numa).
+*/
 class RendezvousBarrier {
   public:
-    RendezvousBarrier(int num_children) : variable_(num_children){};
-
-    // called from parent
-    void wait_all_children_and_send_start(
-        RendezvousBarrierVariable::BarrierType type) {
-        variable_.wait_all_children_ready();
-        variable_.initialize();
-        variable_.send_start_to_all_children(type);
+    static constexpr int FAN_IN = 8;
+    static constexpr int MAX_DEPTH = 4; // leaf, node, root (+ spare)
+
+    RendezvousBarrier(int num_threads) : rounds_(num_threads) {
+        assert(0 < num_threads);
+        std::map<unsigned int, std::vector<uint32_t>> workers_of_node;
+        for (int worker = 0; worker < num_threads; worker++) {
+            workers_of_node[Numa::node_of_cpu(worker)].emplace_back(worker);
+        }
+
+        leaves_.resize(num_threads);
+        std::vector<RendezvousBarrierVariable *> nodes;
+        for (auto &[node, workers] : workers_of_node) {
+            std::vector<RendezvousBarrierVariable *> leaves;
+            for (size_t i = 0; i < workers.size(); i += FAN_IN) {
+                size_t n = std::min<size_t>(FAN_IN, workers.size() - i);
+                RendezvousBarrierVariable *leaf = create(n);
+                for (size_t j = i; j < i + n; j++) {
+                    leaves_[workers[j]] = leaf;
+                }
+                leaves.emplace_back(leaf);
+            }
+            nodes.emplace_back(combine(leaves));
+        }
+        combine(nodes);
     }
 
-    // called from children
-    void
-    send_ready_and_wait_start(RendezvousBarrierVariable::BarrierType type) {
-        variable_.send_ready_to_parent();
-        variable_.wait_start(type);
+    // returns when all the threads have called wait() with the same type
+    void wait(RendezvousBarrierVariable::BarrierType type, uint32_t worker_id) {
+        assert(worker_id < leaves_.size());
+        uint64_t round = ++rounds_[worker_id].round_;
+
+        // climb as long as this thread is the last to arrive
+        RendezvousBarrierVariable *path[MAX_DEPTH];
+        int depth = 0;
+        RendezvousBarrierVariable *variable = leaves_[worker_id];
+        for (;;) {
+            if (!variable->arrive()) {
+                variable->wait_start(round);
+                assert(variable->type_ == type);
+                break;
+            }
+            assert(depth < MAX_DEPTH);
+            path[depth++] = variable;
+            if (!variable->parent_)
+                break; // the last one at the root: everyone has arrived
+            variable = variable->parent_;
+        }
+
+        // release the variables where this thread arrived last, top-down
+        for (int i = depth - 1; 0 <= i; i--) {
+            path[i]->send_start(round, type);
+        }
     }
 
   private:
-    RendezvousBarrierVariable variable_;
+    struct Round {
+        alignas(64) uint64_t round_ = 0; // barriers passed by the worker
+    };
+
+    std::vector<Round> rounds_;
+    std::vector<RendezvousBarrierVariable *> leaves_; // of each worker
+    std::vector<std::unique_ptr<RendezvousBarrierVariable>> variables_;
+
+    RendezvousBarrierVariable *create(size_t num_children) {
+        variables_.emplace_back(
+            std::make_unique<RendezvousBarrierVariable>(num_children));
+        return variables_.back().get();
+    }
+
+    RendezvousBarrierVariable *
+    combine(const std::vector<RendezvousBarrierVariable *> &children) {
+        if (children.size() == 1)
+            return children[0];
+        RendezvousBarrierVariable *parent = create(children.size());
+        for (RendezvousBarrierVariable *child : children) {
+            child->parent_ = parent;
+        }
+        return parent;
+    }
 };
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdexcept>
+#include <vector>
+
+#include "protocols/common/schema.hpp"
+
+/*
+  Looks the rows of all the operations of a transaction up with one
+  MasstreeIndexes::multi_find and caches them in the operations (val_).
+
+  Called once per transaction in the initialization phase, before any
+  append; the protocols then take the cached Value * instead of the key, so
+  neither the initialization nor the execution phase walks Masstree again.
+*/
+template <typename Index, typename Operation>
+void resolve_rows(TableID table_id, std::vector<Operation *> &ops) {
+    using Key = typename Index::Key;
+    using Value = typename Index::Value;
+    thread_local std::vector<Key> keys;
+    thread_local std::vector<Value *> vals;
+
+    keys.clear();
+    for (Operation *ope : ops) {
+        keys.emplace_back(ope->index_);
+    }
+    vals.resize(keys.size());
+
+    typename Index::Result res = Index::get_index().multi_find(
+        table_id, keys.data(), vals.data(), keys.size());
+    if (res == Index::Result::NOT_FOUND) {
+        throw std::runtime_error("masstree NOT_FOUND");
+    }
+
+    for (size_t i = 0; i < ops.size(); i++) {
+        ops[i]->val_ = vals[i];
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <stdexcept>
+
+#include "protocols/ycsb_common/definitions.hpp"
+#include "utils/numa.hpp"
+
+/*
+  How the serial ids of an epoch are laid out over the cores.
+
+      serial id = core * txs_per_core + tx
+      (core < num_cores, tx < txs_per_core)
+
+  The initialization phase of core c appends the transactions
+  c * txs_per_core, ..., (c + 1) * txs_per_core - 1 in order, and the
+  execution phase hands them out round-robin (i * num_cores + worker).
+
+  Both counts are given at runtime. With Pow2 (txs_per_core is a power of
+  two), core() and tx() are a shift and a mask instead of a division; use
+  with_serial_id_layout() to pick the specialization.
+*/
+template <bool Pow2> class SerialIdLayout {
+  public:
+    SerialIdLayout(uint64_t num_cores, uint64_t txs_per_core)
+        : num_cores_(num_cores), txs_per_core_(txs_per_core) {
+        if (num_cores == 0 || LOGICAL_CORE_SIZE < num_cores)
+            throw std::runtime_error("invalid number of cores");
+        // one bit per transaction of a core in the transaction bitmaps
+        if (txs_per_core == 0 || MAX_SLOTS_OF_PER_CORE_ARRAY < txs_per_core)
+            throw std::runtime_error("invalid transactions per core");
+        if (Pow2 != is_power_of_two(txs_per_core))
+            throw std::runtime_error("wrong serial id layout");
+        shift_ = __builtin_ctzll(txs_per_core);
+    }
+
+    static bool is_power_of_two(uint64_t n) {
+        return n != 0 && (n & (n - 1)) == 0;
+    }
+
+    uint64_t num_cores() const { return num_cores_; }
+    uint64_t txs_per_core() const { return txs_per_core_; }
+    uint64_t txs_per_epoch() const { return num_cores_ * txs_per_core_; }
+
+    uint64_t core(uint64_t serial_id) const {
+        if constexpr (Pow2)
+            return serial_id >> shift_;
+        return serial_id / txs_per_core_;
+    }
+
+    uint64_t tx(uint64_t serial_id) const {
+        if constexpr (Pow2)
+            return serial_id & (txs_per_core_ - 1);
+        return serial_id % txs_per_core_;
+    }
+
+    uint64_t serial_id(uint64_t core, uint64_t tx) const {
+        assert(core < num_cores_ && tx < txs_per_core_);
+        if constexpr (Pow2)
+            return core << shift_ | tx;
+        return core * txs_per_core_ + tx;
+    }
+
+    // the i-th transaction of worker in the initialization phase
+    uint64_t sequential(uint64_t worker, uint64_t i) const {
+        return serial_id(worker, i);
+    }
+
+    // the i-th transaction of worker in the execution phase
+    uint64_t round_robin(uint64_t worker, uint64_t i) const {
+        assert(worker < num_cores_ && i < txs_per_core_);
+        return i * num_cores_ + worker;
+    }
+
+  private:
+    uint64_t num_cores_;
+    uint64_t txs_per_core_;
+    uint64_t shift_; // log2(txs_per_core_) if Pow2
+};
+
+// calls f(layout) with the specialization of SerialIdLayout for
+// txs_per_core
+template <typename F>
+void with_serial_id_layout(uint64_t num_cores, uint64_t txs_per_core, F &&f) {
+    if (SerialIdLayout<true>::is_power_of_two(txs_per_core)) {
+        f(SerialIdLayout<true>(num_cores, txs_per_core));
+    } else {
+        f(SerialIdLayout<false>(num_cores, txs_per_core));
+    }
+}
+
+// as close to NUM_TXS_IN_ONE_EPOCH transactions per epoch as the
+// transaction bitmaps allow
+inline uint64_t default_txs_per_core(uint64_t num_cores) {
+    assert(0 < num_cores);
+    uint64_t txs_per_core = NUM_TXS_IN_ONE_EPOCH / num_cores;
+    if (MAX_SLOTS_OF_PER_CORE_ARRAY < txs_per_core)
+        return MAX_SLOTS_OF_PER_CORE_ARRAY;
+    return txs_per_core == 0 ? 1 : txs_per_core;
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "protocols/common/schema.hpp"
+#include "protocols/ycsb_common/parallel_loader.hpp"
+
+/*
+  Binary snapshot of a loaded table: its keys in index order and their
+  records, so that the next run can reload the table instead of building
+  it from scratch. The file does not depend on the protocol.
+
+      [Header (64 bytes) | keys (8 bytes each) | pad | records ]
+                                                     ^ 64-byte aligned
+
+  The file is mapped read-only; the loaders copy the records out of it
+  (the versions own their records) and insert the keys in parallel.
+*/
+class Snapshot {
+  public:
+    static constexpr uint64_t MAGIC = 0x50414e5359564d53; // "SMVYSNAP"
+    static constexpr uint32_t FORMAT_VERSION = 1;
+
+    struct Header {
+        uint64_t magic_;
+        uint32_t format_version_;
+        uint32_t record_size_;
+        uint64_t num_records_;
+        TableID table_id_;
+        char pad_[32];
+    };
+    static_assert(sizeof(Header) == 64);
+
+    static bool exists(const std::string &path) {
+        return access(path.c_str(), R_OK) == 0;
+    }
+
+    // writes the records of keys[0, n); record(key) returns the record of
+    // key. The file appears under path only once it is complete
+    template <typename F>
+    static void write(const std::string &path, TableID table_id,
+                      size_t record_size, const std::vector<uint64_t> &keys,
+                      const F &record) {
+        std::string tmp_path = path + ".tmp";
+        FILE *file = fopen(tmp_path.c_str(), "wb");
+        if (!file)
+            throw std::runtime_error("cannot create snapshot " + tmp_path);
+
+        Header header = {};
+        header.magic_ = MAGIC;
+        header.format_version_ = FORMAT_VERSION;
+        header.record_size_ = record_size;
+        header.num_records_ = keys.size();
+        header.table_id_ = table_id;
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = ok && fwrite(keys.data(), sizeof(uint64_t), keys.size(), file) ==
+                       keys.size();
+        static const char zeros[64] = {};
+        size_t pad = records_offset(keys.size()) - keys_end(keys.size());
+        ok = ok && fwrite(zeros, 1, pad, file) == pad;
+        for (uint64_t key : keys) {
+            if (!ok)
+                break;
+            ok = fwrite(record(key), record_size, 1, file) == 1;
+        }
+        ok = fclose(file) == 0 && ok;
+        if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+            unlink(tmp_path.c_str());
+            throw std::runtime_error("cannot write snapshot " + path);
+        }
+    }
+
+    // maps the snapshot at path, which must hold num_records records of
+    // table_id of record_size bytes
+    Snapshot(const std::string &path, TableID table_id, size_t record_size,
+             uint64_t num_records) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+            throw std::runtime_error("cannot open snapshot " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header)) {
+            close(fd);
+            throw std::runtime_error("broken snapshot " + path);
+        }
+        size_ = st.st_size;
+        void *p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED)
+            throw std::runtime_error("cannot map snapshot " + path);
+        base_ = static_cast<const char *>(p);
+        madvise(p, size_, MADV_WILLNEED);
+
+        const Header *header = reinterpret_cast<const Header *>(base_);
+        num_records_ = header->num_records_;
+        record_size_ = header->record_size_;
+        if (header->magic_ != MAGIC ||
+            header->format_version_ != FORMAT_VERSION ||
+            header->table_id_ != table_id || record_size_ != record_size ||
+            num_records_ != num_records ||
+            size_ < records_offset(num_records_) + num_records_ * record_size_) {
+            munmap(p, size_);
+            throw std::runtime_error("snapshot " + path +
+                                     " does not match the table");
+        }
+    }
+
+    ~Snapshot() { munmap(const_cast<char *>(base_), size_); }
+
+    Snapshot(const Snapshot &) = delete;
+    Snapshot &operator=(const Snapshot &) = delete;
+
+    uint64_t num_records() const { return num_records_; }
+
+    uint64_t key(uint64_t i) const {
+        assert(i < num_records_);
+        uint64_t key;
+        memcpy(&key, base_ + sizeof(Header) + i * sizeof(uint64_t),
+               sizeof(key));
+        return key;
+    }
+
+    const void *record(uint64_t i) const {
+        assert(i < num_records_);
+        return base_ + records_offset(num_records_) + i * record_size_;
+    }
+
+  private:
+    const char *base_;
+    size_t size_;
+    uint64_t num_records_;
+    size_t record_size_;
+
+    static size_t keys_end(uint64_t n) {
+        return sizeof(Header) + n * sizeof(uint64_t);
+    }
+
+    static size_t records_offset(uint64_t n) {
+        return (keys_end(n) + 63) & ~static_cast<size_t>(63);
+    }
+};
+
+/*
+  Loads table_id with num_threads loaders (see parallel_load()):
+  load(key, image) creates the row of key, with a copy of the record image,
+  or a new record if image is nullptr.
+
+  Without a snapshot path, the keys are 0, ..., num_records - 1 and the
+  records are new. With one, the table is restored from the snapshot if it
+  exists, and otherwise loaded as without and then written to the path,
+  record_of(key) giving the record of each key.
+*/
+template <typename Load, typename RecordOf>
+void load_table(TableID table_id, size_t record_size, uint64_t num_records,
+                uint64_t num_threads, const std::string &snapshot_path,
+                const Load &load, const RecordOf &record_of) {
+    if (!snapshot_path.empty() && Snapshot::exists(snapshot_path)) {
+        Snapshot snapshot(snapshot_path, table_id, record_size, num_records);
+        parallel_load(num_records, num_threads, [&](uint64_t i) {
+            load(snapshot.key(i), snapshot.record(i));
+        });
+        return;
+    }
+
+    parallel_load(num_records, num_threads,
+                  [&](uint64_t key) { load(key, nullptr); });
+    if (!snapshot_path.empty()) {
+        std::vector<uint64_t> keys(num_records);
+        for (uint64_t key = 0; key < num_records; key++) {
+            keys[key] = key;
+        }
+        Snapshot::write(snapshot_path, table_id, record_size, keys, record_of);
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+/*
+  Transactions of the execution phase that are waiting for a PENDING
+  version, kept by the worker that suspended them.
+
+  A transaction is a list of operations, so a stackless continuation is
+  enough to resume it: the serial id, the position of the read it stopped
+  at, and the version that read is waiting for. Instead of spinning, the
+  worker runs its next transaction and checks the suspended ones in
+  between.
+
+  Nothing is lost by suspending: a transaction only waits for versions
+  written by smaller serial ids, and the smallest unfinished serial id is
+  never blocked, so every suspended transaction eventually becomes ready.
+*/
+template <typename Version> class SuspendedTransactions {
+  public:
+    struct Continuation {
+        uint64_t serial_id_;
+        uint32_t pos_;     // the operation to resume from
+        Version *visible_; // the version the read at pos_ waits for
+    };
+
+    SuspendedTransactions(uint64_t capacity) { suspended_.reserve(capacity); }
+
+    bool empty() const { return suspended_.empty(); }
+    uint64_t size() const { return suspended_.size(); }
+
+    void suspend(const Continuation &c) {
+        assert(c.visible_);
+        suspended_.emplace_back(c);
+    }
+
+    // takes a transaction whose version has become STABLE, if any
+    bool pop_ready(Continuation &c) {
+        for (size_t i = 0; i < suspended_.size(); i++) {
+            if (__atomic_load_n(&suspended_[i].visible_->status,
+                                __ATOMIC_SEQ_CST) !=
+                Version::VersionStatus::PENDING) {
+                c = suspended_[i];
+                suspended_[i] = suspended_.back();
+                suspended_.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+  private:
+    std::vector<Continuation> suspended_;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <new>
+
+#include "protocols/ycsb_common/definitions.hpp"
+#include "utils/utils.hpp"
+
+/*
+  Where the initializers place the Values of a table.
+
+  With VALUE_SLAB, all the Values are slots of one cache-line-aligned array
+  allocated at load time, in key order: the Value of key k is slots_[k].
+  There is no allocator header or free block between two rows, and rows of
+  close keys are close in memory. Otherwise every Value is allocated on its
+  own, as before.
+
+  Values are never freed, so neither is the slab.
+*/
+template <typename Value, typename Allocator> class ValueSlab {
+  public:
+    explicit ValueSlab(uint64_t num_values) : num_values_(num_values) {
+#if VALUE_SLAB
+        static_assert(sizeof(Value) % alignof(Value) == 0);
+        constexpr size_t align = alignof(Value) < 64 ? 64 : alignof(Value);
+        slots_ = static_cast<Value *>(
+            Allocator::aligned_allocate(num_values * sizeof(Value), align));
+        if (!slots_) throw std::bad_alloc();
+#endif
+    }
+
+    // memory for the Value of key, to be constructed by the caller
+    void *allocate(uint64_t key) {
+        assert(key < num_values_);
+#if VALUE_SLAB
+        return &slots_[key];
+#else
+        unused(key);
+        void *mem = Allocator::aligned_allocate(sizeof(Value), alignof(Value));
+        if (!mem) throw std::bad_alloc();
+        return mem;
+#endif
+    }
+
+  private:
+    uint64_t num_values_;
+    Value *slots_ = nullptr;
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <limits>
+
+#include "utils/numa.hpp"
+
+/*
+  Work-stealing scheduler for the execution phase.
+
+  Worker w owns the round-robin transactions of the epoch,
+      serial id = i * num_workers + w (i = 0, 1, ..., txs_per_worker - 1),
+  and its queue is just the index i of the next one (head_). The owner and
+  the thieves both take transactions from the head, so every queue is
+  consumed in increasing serial-id order.
+
+  A worker whose queue is empty steals the transaction with the smallest
+  serial id among the heads of all queues, i.e. the one that is most likely
+  to be ready (all the versions it reads are written by smaller serial ids).
+  This also guarantees progress: the smallest unfinished serial id is either
+  running or at the head of a queue whose owner is not blocked, so it is
+  eventually executed and nobody waits forever.
+
+  Which worker runs a transaction does not matter for the result: the
+  protocols only depend on the serial id.
+
+  The queues are refilled by their owners before the ExecPhase barrier and
+  are only consumed after it; once every queue is empty, they stay empty
+  until the next epoch. head_ is tagged with the epoch: with
+  PIPELINED_EPOCHS, an owner may refill its queue for epoch N + 1 while
+  other workers are still stealing in epoch N.
+*/
+class WorkStealingQueues {
+  public:
+    WorkStealingQueues(uint32_t num_workers, uint32_t txs_per_worker)
+        : num_workers_(num_workers), txs_per_worker_(txs_per_worker) {
+        assert(num_workers_ <= LOGICAL_CORE_SIZE);
+        for (uint32_t w = 0; w < LOGICAL_CORE_SIZE; w++) {
+            queues_[w].head_ = 0; // epoch 0: empty
+        }
+    }
+
+    // called from the owner before the ExecPhase barrier
+    void refill(uint32_t worker, uint64_t epoch) {
+        __atomic_store_n(&queues_[worker].head_, pack(epoch, 0),
+                         __ATOMIC_SEQ_CST);
+    }
+
+    // returns false once all the transactions of the epoch have been taken
+    bool next(uint32_t worker, uint64_t epoch, uint64_t &serial_id,
+              bool &stolen) {
+        stolen = false;
+        if (take(worker, epoch, serial_id))
+            return true;
+        stolen = true;
+        return steal(epoch, serial_id);
+    }
+
+  private:
+    struct Queue {
+        alignas(64) uint64_t head_; // epoch (upper 32 bits) | index
+    };
+
+    uint32_t num_workers_;
+    uint32_t txs_per_worker_;
+    Queue queues_[LOGICAL_CORE_SIZE];
+
+    static uint64_t pack(uint64_t epoch, uint64_t i) {
+        return epoch << 32 | i;
+    }
+
+    // the index of the next transaction of epoch, txs_per_worker_ if empty
+    uint64_t peek(uint32_t worker, uint64_t epoch) {
+        uint64_t head =
+            __atomic_load_n(&queues_[worker].head_, __ATOMIC_SEQ_CST);
+        if ((head >> 32) != epoch)
+            return txs_per_worker_; // refilled for another epoch
+        return head & 0xFFFFFFFF;
+    }
+
+    bool take(uint32_t victim, uint64_t epoch, uint64_t &serial_id) {
+        uint64_t head =
+            __atomic_load_n(&queues_[victim].head_, __ATOMIC_SEQ_CST);
+        for (;;) {
+            uint64_t i = head & 0xFFFFFFFF;
+            if ((head >> 32) != epoch || txs_per_worker_ <= i)
+                return false;
+            if (__atomic_compare_exchange_n(&queues_[victim].head_, &head,
+                                            head + 1, false, __ATOMIC_SEQ_CST,
+                                            __ATOMIC_SEQ_CST)) {
+                serial_id = i * num_workers_ + victim;
+                return true;
+            }
+        }
+    }
+
+    bool steal(uint64_t epoch, uint64_t &serial_id) {
+        for (;;) {
+            uint32_t victim = 0;
+            uint64_t min_serial = std::numeric_limits<uint64_t>::max();
+            for (uint32_t w = 0; w < num_workers_; w++) {
+                uint64_t i = peek(w, epoch);
+                if (i < txs_per_worker_) {
+                    uint64_t serial = i * num_workers_ + w;
+                    if (serial < min_serial) {
+                        min_serial = serial;
+                        victim = w;
+                    }
+                }
+            }
+            if (min_serial == std::numeric_limits<uint64_t>::max())
+                return false; // every queue is empty
+            if (take(victim, epoch, serial_id))
+                return true;
+            // another worker emptied the victim in the meantime
+        }
+    }
+};
@@ -17,6 +17,7 @@ class Plot:
       "Node": "Node",
       "Create": "Version Created Per-core",
       "Delete": "Reclaimed Versions",
+      "LoadTime": "Load Latency",
       "TotalTime": "Total Latency",
       "InitializationTime": "Initialization Latency",
       "ExecutionTime": "Execution Latency",
@@ -25,6 +26,11 @@ class Plot:
       "WaitInInitialization": "Wait in Initialization",
       "WaitInExecution": "Wait in Execution",
       "WaitInGC": "Wait in GC",
+      "WaitForLog": "Wait for Log",
+      "MaterializedArrays": "Materialized Per-core Arrays",
+      "StolenTransactions": "Stolen Transactions",
+      "Suspensions": "Suspended Reads",
+      "ArenaChunks": "Arena Chunks Per-core",
       "AppendTime": "AppendTime",
       "ExecReadTime": "ExecReadTime",
       "ExecWriteTime": "ExecWriteTime",
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+
+import os
+import re
+import subprocess
+
+import pandas as pd
+import matplotlib.pyplot as plt
+
+# EXECUTE THIS SCRIPT IN BASE DIRECTORY!!!
+
+# Recovery benchmark: for every protocol and #threads, a run with the command
+# log (COMMAND_LOG=1) writes its log and the hash of its final database,
+# then the recovery reloads the checkpoint (snapshot of the load), replays
+# the log with the same #threads and checks the hash.
+# The replay is parallel: its throughput should scale with #threads.
+# The payloads beyond 8 bytes also check that the bytes of a record not set
+# by the logged value are rebuilt by the replay.
+
+protocols = ["caracal", "serval", "cheetah"]
+threads = [1, 8, 16, 32, 64]
+NUM_TRIALS = 3
+
+payloads = [4, 1024]  # 4: same default as scripts/ycsb.py
+RECORDS = 10000000
+WORKLOAD = "A"
+SKEW = 0.9
+REPS = 10
+NUM_SECONDS = 1
+
+CMAKE_BUILD_TYPE = "Release"
+
+
+def binary(protocol, payload):
+    # FILENAME of CMakeLists.txt with the parameters of build()
+    return "./ycsb" + str(payload) + "_255_4096_0_0_1_0_0_0_1_" + protocol
+
+
+def build():
+    if not os.path.exists("./build"):
+        os.mkdir("./build")
+    os.chdir("./build")
+    if not os.path.exists("./log"):
+        os.mkdir("./log")  # compile logs
+    for protocol in protocols:
+        for payload in payloads:
+            print("Compiling " + protocol + " PAYLOAD_SIZE=" + str(payload)
+                  + " COMMAND_LOG=1")
+            logfile = ("./log/recovery_" + protocol + "_" + str(payload)
+                       + ".compile_log")
+            ret = os.system(
+                "cmake .. -DLOG_LEVEL=0 -DCMAKE_BUILD_TYPE=" + CMAKE_BUILD_TYPE
+                + " -DBENCHMARK=YCSB -DCC_ALG=" + protocol.upper()
+                + " -DPAYLOAD_SIZE=" + str(payload)
+                + " -DMAX_SLOTS_OF_PER_CORE_BUFFER=255 -DNUM_TXS_IN_ONE_EPOCH=4096"
+                + " -DBCBU=0 -DRC=0 -DINLINE_VERSION_SLOTS=1 -DPIPELINED_EPOCHS=0"
+                + " -DARRAY_INDEX=0 -DVALUE_SLAB=0"
+                + " -DCOMMAND_LOG=1 > " + logfile + " 2>&1"
+                + " && make -j >> " + logfile + " 2>&1"
+            )
+            if ret != 0:
+                print("Error. Stopping")
+                exit(0)
+    os.chdir("../")  # go back to base directory
+
+
+def run(protocol, payload, thread, options):
+    args = [binary(protocol, payload), str(NUM_SECONDS), protocol, WORKLOAD,
+            str(RECORDS), str(thread), str(SKEW), str(REPS), "0", *options]
+    out = subprocess.run(args, stdout=subprocess.PIPE,
+                         stderr=subprocess.STDOUT, text=True)
+    return out.returncode, out.stdout
+
+
+def run_all():
+    os.chdir("./build/bin")  # move to bin
+    for directory in ["./res", "./logs", "./snapshots"]:
+        if not os.path.exists(directory):
+            os.mkdir(directory)
+
+    rows = []
+    for protocol in protocols:
+        for payload in payloads:
+            snapshot = "snapshot=./snapshots/ycsb" + str(payload) + "_" + str(RECORDS) + ".snap"
+            for thread in threads:
+                log = ("./logs/recovery_" + protocol + "_" + str(payload) + "_"
+                       + str(thread) + ".log")
+                for trial in range(NUM_TRIALS):
+                    print("[{} payload {} {} threads] trial {}".format(
+                        protocol, payload, thread, trial))
+                    ret, _ = run(protocol, payload, thread, [snapshot, "log=" + log])
+                    if ret != 0:
+                        print("Error. Stopping")
+                        exit(0)
+                    # fails (ret != 0) if the hash of the replayed database
+                    # does not match the one of the logged run
+                    ret, out = run(protocol, payload, thread, [snapshot, "recover=" + log])
+                    m = re.search(r"Recovered in (\d+) ms \(replay of (\d+) transactions: (\d+) ms\)", out)
+                    if ret != 0 or not m:
+                        print(out)
+                        print("Recovery failed. Stopping")
+                        exit(0)
+                    recovery_ms, txs, replay_ms = map(int, m.groups())
+                    rows.append([protocol, payload, thread, trial, recovery_ms, replay_ms,
+                                 txs, txs / max(replay_ms, 1) / 1000])  # Mtx/s
+    df = pd.DataFrame(rows, columns=["protocol", "payload", "num_threads", "trial",
+                                     "RecoveryTime", "ReplayTime", "Transactions",
+                                     "ReplayThroughput"])
+    df.to_csv("./res/recovery.csv", index=False)
+    os.chdir("../../")  # back to base directory
+    return df
+
+
+def plot_all(df):
+    mean = df.groupby(["protocol", "payload", "num_threads"]).mean(
+        numeric_only=True).reset_index()
+    print(mean[["protocol", "payload", "num_threads", "RecoveryTime", "ReplayTime",
+                "ReplayThroughput"]])
+    fig, ax = plt.subplots()
+    for protocol in protocols:
+        for payload in payloads:
+            d = mean[(mean["protocol"] == protocol) & (mean["payload"] == payload)]
+            ax.plot(d["num_threads"], d["ReplayThroughput"], marker="o",
+                    label=protocol + " (" + str(payload) + "B)")
+    ax.set_xlabel("#thread")
+    ax.set_ylabel("Replay Throughput (Mtx/s)")
+    ax.legend()
+    fig.savefig("./build/bin/res/recovery.pdf")
+
+
+if __name__ == "__main__":
+    build()
+    plot_all(run_all())
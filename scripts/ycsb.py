@@ -17,6 +17,8 @@ import module.setting as setting
 NUM_EXPERIMENTS_PER_SETUP = 10
 NUM_SECONDS = 1  
 VARYING_TYPE = "contention"  
+# Load the tables from ./build/bin/snapshots (written by the first run of each payload and #records)
+USE_SNAPSHOTS = True
 
 x_label = {
     "num_threads": "#thread",
@@ -44,28 +46,46 @@ protocols = ["caracal", "serval", "cheetah"]
 CMAKE_BUILD_TYPE = "Release"
 
 
-def add_options_to_protocol(protocol, bcbu, rc):
+def add_options_to_protocol(protocol, bcbu, rc, inline_slots, pipelined, array_index, value_slab, command_log):
     options = [protocol]
     if bcbu:
         options.append("BCBU")
     if rc:
         options.append("RC")
+    if not inline_slots:
+        options.append("VEC")
+    if pipelined:
+        options.append("PIPE")
+    if array_index:
+        options.append("ARR")
+    if value_slab:
+        options.append("SLAB")
+    if command_log:
+        options.append("LOG")
     return "_".join(options)
 
 def gen_setups():
     payloads = [4]
 
     # =========== for caracal ===========
-    buffer_slots = [255] # 255
+    buffer_slots = [255] # 255. [1, 4, 16, 64, 255] to sweep
     # ===================================
 
     # =========== for serval (IGNORE THIS PART)===========
     bcbus = [0] # batch_core_bitmap_updates: 0 is good
     rcs = [0] # reference counter (read counter)
+    inline_slotss = [1] # per-core version array: 1 inline 64 slots, 0 std::vector. [1, 0] to compare
+    # ===================================
+
+    # =========== for serval and caracal ===========
+    pipelineds = [0] # 1: overlap initialization of epoch N+1 with execution of epoch N. [0, 1] to compare
     # ===================================
 
     # =========== common ===========
     txs_in_epochs = [4096] # DO NOT CHANGE
+    array_indexes = [0] # 1: direct-mapped array index instead of Masstree (no index overhead). [0, 1] to compare
+    value_slabs = [0] # 1: key-ordered slab of Values with the compacted row layout. [0, 1] to compare
+    command_logs = [0] # 1: log the batch of every epoch (group commit per epoch) to ./build/bin/logs. [0, 1] to compare
     # ===================================
 
     # =========== workload parameters ===========
@@ -90,9 +110,9 @@ def gen_setups():
 
     return [
         [
-            [protocol, str(payload), str(buffer_slot), str(txs_in_epoch), str(bcbu), str(rc)],
+            [protocol, str(payload), str(buffer_slot), str(txs_in_epoch), str(bcbu), str(rc), str(inline_slots), str(pipelined), str(array_index), str(value_slab), str(command_log)],
             [
-                add_options_to_protocol(protocol, bcbu, rc),
+                add_options_to_protocol(protocol, bcbu, rc, inline_slots, pipelined, array_index, value_slab, command_log),
                 workload,
                 str(record),
                 str(thread),
@@ -106,6 +126,11 @@ def gen_setups():
         for txs_in_epoch in txs_in_epochs
         for bcbu in bcbus
         for rc in rcs
+        for inline_slots in inline_slotss
+        for pipelined in pipelineds
+        for array_index in array_indexes
+        for value_slab in value_slabs
+        for command_log in command_logs
         for workload in workloads
         for record in records
         for thread in threads
@@ -121,8 +146,8 @@ def build():
     if not os.path.exists("./log"):
         os.mkdir("./log")  # compile logs
     for setup in gen_setups():
-        [[protocol, payload, buffer_slot, txs_in_epoch, bcbu, rc], _] = setup
-        print("Compiling " + " PAYLOAD_SIZE=" + payload + " MAX_SLOTS_OF_PER_CORE_BUFFER=" + buffer_slot + " NUM_TXS_IN_ONE_EPOCH=" + txs_in_epoch + " BCBU=" + bcbu, " RC=" + rc)
+        [[protocol, payload, buffer_slot, txs_in_epoch, bcbu, rc, inline_slots, pipelined, array_index, value_slab, command_log], _] = setup
+        print("Compiling " + " PAYLOAD_SIZE=" + payload + " MAX_SLOTS_OF_PER_CORE_BUFFER=" + buffer_slot + " NUM_TXS_IN_ONE_EPOCH=" + txs_in_epoch + " BCBU=" + bcbu, " RC=" + rc, " INLINE_VERSION_SLOTS=" + inline_slots, " PIPELINED_EPOCHS=" + pipelined, " ARRAY_INDEX=" + array_index, " VALUE_SLAB=" + value_slab, " COMMAND_LOG=" + command_log)
         logfile = "_PAYLOAD_SIZE" + payload + "_MAX_SLOTS_OF_PER_CORE_BUFFER" + buffer_slot + ".compile_log"
         os.system(
             "cmake .. -DLOG_LEVEL=0 -DCMAKE_BUILD_TYPE="
@@ -139,6 +164,16 @@ def build():
             + bcbu
             + " -DRC="
             + rc
+            + " -DINLINE_VERSION_SLOTS="
+            + inline_slots
+            + " -DPIPELINED_EPOCHS="
+            + pipelined
+            + " -DARRAY_INDEX="
+            + array_index
+            + " -DVALUE_SLAB="
+            + value_slab
+            + " -DCOMMAND_LOG="
+            + command_log
             + " > ./log/"
             + "compile_"
             + logfile
@@ -156,14 +191,23 @@ def run_all():
     if not os.path.exists("./res"):
         os.mkdir("./res")  # create result directory inside bin
         os.mkdir("./res/tmp")
+    if USE_SNAPSHOTS and not os.path.exists("./snapshots"):
+        os.mkdir("./snapshots")
+    if not os.path.exists("./logs"):
+        os.mkdir("./logs")  # command logs (COMMAND_LOG)
     for setup in gen_setups():
         [
-            [protocol, payload, buffer_slot, txs_in_epoch, bcbu, rc],
+            [protocol, payload, buffer_slot, txs_in_epoch, bcbu, rc, inline_slots, pipelined, array_index, value_slab, command_log],
             args,
         ] = setup
-        title = "ycsb" + payload + "_" + buffer_slot + "_" + txs_in_epoch + "_" + bcbu + "_" + rc + "_" + protocol
+        title = "ycsb" + payload + "_" + buffer_slot + "_" + txs_in_epoch + "_" + bcbu + "_" + rc + "_" + inline_slots + "_" + pipelined + "_" + array_index + "_" + value_slab + "_" + command_log + "_" + protocol
 
         print("[{}: {}]".format(title, " ".join([str(NUM_SECONDS), *args])))
+        options = []
+        if USE_SNAPSHOTS:  # the tables depend on the payload and #records only
+            options.append("snapshot=./snapshots/ycsb" + payload + "_" + args[2] + ".snap")
+        if command_log == "1":
+            options.append("log=./logs/" + title + ".log")
 
         for exp_id in range(NUM_EXPERIMENTS_PER_SETUP):
             dt_now = datetime.datetime.now()
@@ -173,7 +217,7 @@ def run_all():
                 "./"
                 + title
                 + " "
-                + " ".join([str(NUM_SECONDS), *args, str(exp_id)])
+                + " ".join([str(NUM_SECONDS), *args, str(exp_id), *options])
                 + " > ./res/tmp/"
                 + str(dt_now.isoformat())
                 + " 2>&1"
@@ -208,7 +252,7 @@ def plot_all():
         protocol_df = df[df["protocol"] == protocol]
         protocol_grouped_df = protocol_df.groupby(compile_param + runtime_param, as_index=False).sum()
         for column in protocol_grouped_df.columns:
-            if column in ["Create","Delete","TotalTime","InitializationTime","ExecutionTime","Sync1Time","Sync2Time","WaitInInitialization","WaitInExecution","WaitInGC","PerfLeader","PerfMember"]:
+            if column in ["Create","Delete","LoadTime","TotalTime","InitializationTime","ExecutionTime","Sync1Time","Sync2Time","WaitInInitialization","WaitInExecution","WaitInGC","WaitForLog","MaterializedArrays","StolenTransactions","Suspensions","ArenaChunks","PerfLeader","PerfMember"]:
                 protocol_grouped_df[column] = protocol_grouped_df[column] / 64 / NUM_EXPERIMENTS_PER_SETUP
         grouped_dfs[protocol] = protocol_grouped_df
         dfs[protocol] = protocol_df
@@ -218,7 +262,7 @@ def plot_all():
         os.mkdir("./plots")  # create plot directory inside res
     os.chdir("./plots")
     
-    plot_params = ["Create","Delete","TotalTime","InitializationTime","ExecutionTime","Sync1Time","Sync2Time","WaitInInitialization","WaitInExecution","WaitInGC","PerfLeader","PerfMember"]
+    plot_params = ["Create","Delete","LoadTime","TotalTime","InitializationTime","ExecutionTime","Sync1Time","Sync2Time","WaitInInitialization","WaitInExecution","WaitInGC","WaitForLog","MaterializedArrays","StolenTransactions","Suspensions","ArenaChunks","PerfLeader","PerfMember"]
     my_plot = plot.Plot(
         VARYING_TYPE,
         x_label,
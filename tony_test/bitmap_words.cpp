@@ -0,0 +1,111 @@
+// Bitmap<N> over several words (MAX_CORES > 64), checked against a naive
+// per-bit scan. The multi-word paths never run on a machine with 64 cores
+// or less, so run this before a MAX_CORES=128 build.
+//
+// g++ -std=c++17 -O2 -I. tony_test/bitmap_words.cpp -o bitmap_words
+#include <bitset>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <utility>
+
+#include "utils/bitmap.hpp"
+
+int failures = 0;
+
+template <typename T>
+void expect(const T &actual, const T &expected, const char *what, int pos) {
+    if (actual == expected)
+        return;
+    if (failures++ < 10)
+        std::cout << what << " at " << pos << " is wrong" << std::endl;
+}
+
+// the largest set position <= pos, -1 if none
+template <size_t N> int naive_largest(const std::bitset<N> &bits, int pos) {
+    for (int p = pos; 0 <= p; p--) {
+        if (bits[p])
+            return p;
+    }
+    return -1;
+}
+
+template <size_t N> void check(const std::bitset<N> &bits) {
+    Bitmap<N> bitmap, atomic;
+    for (size_t p = 0; p < N; p++) {
+        if (bits[p]) {
+            bitmap.set(p);
+            atomic.set_atomic(p);
+        }
+    }
+
+    expect(bitmap.any(), bits.any(), "any", -1);
+    expect(atomic.any_atomic(), bits.any(), "any_atomic", -1);
+    expect(bitmap.count(), (int)bits.count(), "count", -1);
+    expect(bitmap.find_largest(), naive_largest(bits, N - 1), "find_largest",
+           -1);
+
+    int before = 0;
+    for (int pos = 0; pos < (int)N; pos++) {
+        expect(bitmap.test(pos), (bool)bits[pos], "test", pos);
+        expect(atomic.test_atomic(pos), (bool)bits[pos], "test_atomic", pos);
+        expect(bitmap.count_before(pos), before, "count_before", pos);
+        before += bits[pos];
+
+        int first = naive_largest(bits, pos);
+        int second = first == -1 ? -1 : naive_largest(bits, first - 1);
+        expect(bitmap.find_largest_among_or_less_than(pos), first,
+               "find_largest_among_or_less_than", pos);
+        expect(bitmap.find_largest_among_less_than(pos),
+               naive_largest(bits, pos - 1), "find_largest_among_less_than",
+               pos);
+        expect(bitmap.find_two_largest_among_or_less_than(pos),
+               std::make_pair(second, first),
+               "find_two_largest_among_or_less_than", pos);
+    }
+
+    atomic.clear_atomic();
+    expect(atomic.any_atomic(), false, "clear_atomic", -1);
+}
+
+template <size_t N> void check_all(std::mt19937_64 &rnd) {
+    // the bits around the word boundaries, alone and in pairs
+    for (size_t a = 0; a < N; a++) {
+        if (a % 64 != 0 && a % 64 != 63)
+            continue;
+        for (size_t b = 0; b < N; b++) {
+            std::bitset<N> bits;
+            bits.set(a);
+            bits.set(b);
+            check(bits);
+        }
+    }
+
+    // empty, full, and random with a few bits to most bits set
+    check(std::bitset<N>());
+    check(std::bitset<N>().set());
+    for (int density : {2, 8, 32, 128}) {
+        for (int i = 0; i < 1000; i++) {
+            std::bitset<N> bits;
+            for (size_t p = 0; p < N; p++) {
+                if (rnd() % density == 0)
+                    bits.set(p);
+            }
+            check(bits);
+        }
+    }
+}
+
+int main() {
+    std::mt19937_64 rnd(1);
+    check_all<64>(rnd);
+    check_all<128>(rnd);
+    check_all<192>(rnd);
+
+    if (failures) {
+        std::cout << failures << " failure(s)" << std::endl;
+        return 1;
+    }
+    std::cout << "ok" << std::endl;
+    return 0;
+}
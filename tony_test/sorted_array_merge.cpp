@@ -0,0 +1,131 @@
+// SmallSortedArray::merge() (Caracal's batch append) checked against
+// repeated insert() of the same pairs:
+// - random arrays, with ids drawn from a small range so that they repeat:
+//   a merged element goes after the existing ones with the same id
+// - arrays and batches that grow past INLINE
+// - batches of a PerCoreBuffer appended out of order, through sorted_slots()
+//
+// with the definitions of a ycsb build (see CMakeLists.txt), e.g.
+// g++ -std=c++17 -O2 -I. -I<mimalloc>/include -DPAYLOAD_SIZE=4
+//     -DMAX_SLOTS_OF_PER_CORE_BUFFER=255 -DNUM_TXS_IN_ONE_EPOCH=4096 -DBCBU=0
+//     -DRC=0 -DINLINE_VERSION_SLOTS=1 -DPIPELINED_EPOCHS=0 -DLOG_LEVEL=0
+//     tony_test/sorted_array_merge.cpp
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "benchmarks/ycsb/include/config.hpp"
+#include "benchmarks/ycsb/include/record_layout.hpp"
+#include "benchmarks/ycsb/include/tx_utils.hpp"
+#include "protocols/caracal/include/row_buffer.hpp"
+#include "utils/small_sorted_array.hpp"
+
+int failures = 0;
+
+template <typename Id, typename T, uint32_t INLINE>
+bool same(SmallSortedArray<Id, T, INLINE> &a,
+          SmallSortedArray<Id, T, INLINE> &b) {
+    if (a.size() != b.size())
+        return false;
+    for (uint32_t i = 0; i < a.size(); i++) {
+        if (a.id_at(i) != b.id_at(i) || a.value_at(i) != b.value_at(i))
+            return false;
+    }
+    return true;
+}
+
+template <typename Id, uint32_t INLINE>
+void check_random(std::mt19937_64 &rnd, uint32_t max_size, Id max_id) {
+    SmallSortedArray<Id, uint64_t, INLINE> merged, inserted;
+    uint64_t tag = 0; // values in insertion order: tell equal ids apart
+    uint32_t size = rnd() % max_size;
+    for (uint32_t i = 0; i < size; i++) {
+        Id id = rnd() % max_id;
+        merged.insert(id, tag);
+        inserted.insert(id, tag);
+        tag++;
+    }
+
+    std::vector<std::pair<Id, uint64_t>> batch(rnd() % max_size);
+    for (auto &pair : batch)
+        pair = {static_cast<Id>(rnd() % max_id), 0};
+    std::stable_sort(batch.begin(), batch.end(),
+                     [](const auto &a, const auto &b) {
+                         return a.first < b.first;
+                     });
+    for (auto &pair : batch) {
+        pair.second = tag++;
+        inserted.insert(pair.first, pair.second);
+    }
+    merged.merge(batch.begin(), batch.end());
+
+    if (!same(merged, inserted) && failures++ < 10)
+        std::cout << "merge of " << batch.size() << " into " << size
+                  << " differs from insert" << std::endl;
+}
+
+// a core appends to its buffer in serial order, except after stealing
+void check_per_core_buffer(std::mt19937_64 &rnd) {
+    SmallSortedArray<uint64_t, Version *, GlobalVersionArray::INLINE_SLOTS>
+        merged, inserted;
+    for (uint64_t serial_id = 0; serial_id < rnd() % 16; serial_id++) {
+        Version *version = reinterpret_cast<Version *>(serial_id + 1);
+        uint64_t global_id = convert_to_serial_id_with_epoch(1, serial_id);
+        merged.insert(global_id, version);
+        inserted.insert(global_id, version);
+    }
+
+    PerCoreBuffer buffer;
+    std::vector<uint64_t> serial_ids(
+        std::min<uint64_t>(MAX_SLOTS_OF_PER_CORE_BUFFER, 64));
+    for (uint64_t i = 0; i < serial_ids.size(); i++)
+        serial_ids[i] = i;
+    bool in_order = rnd() % 2;
+    if (!in_order)
+        std::shuffle(serial_ids.begin(), serial_ids.end(), rnd);
+    uint32_t n = 1 + rnd() % serial_ids.size();
+    for (uint32_t i = 0; i < n; i++) {
+        Version *version = reinterpret_cast<Version *>(1000 + serial_ids[i]);
+        buffer.appendable(version, 2, serial_ids[i]);
+        inserted.insert(convert_to_serial_id_with_epoch(2, serial_ids[i]),
+                        version);
+    }
+    bool was_sorted = buffer.sorted_;
+
+    const auto &slots = buffer.sorted_slots();
+    bool ascending = std::is_sorted(slots.begin(), slots.end(),
+                                    [](const auto &a, const auto &b) {
+                                        return a.first < b.first;
+                                    });
+    merged.merge(slots.begin(), slots.end());
+    buffer.clear_slots();
+
+    if ((!ascending || (in_order && !was_sorted) ||
+         !same(merged, inserted)) &&
+        failures++ < 10)
+        std::cout << "batch of " << n << " slots ("
+                  << (in_order ? "in order" : "out of order")
+                  << ") differs from insert" << std::endl;
+}
+
+int main() {
+    std::mt19937_64 rnd(1);
+    for (int i = 0; i < 100000; i++) {
+        // mostly within INLINE, then growing past it
+        check_random<uint64_t, 8>(rnd, 12, 8);
+        check_random<uint64_t, 8>(rnd, 64, 32);
+        check_random<int32_t, 4>(rnd, 24, 6);
+        check_random<uint32_t, 16>(rnd, 100, 1000);
+        check_per_core_buffer(rnd);
+    }
+
+    if (failures) {
+        std::cout << failures << " failure(s)" << std::endl;
+        return 1;
+    }
+    std::cout << "ok" << std::endl;
+    return 0;
+}
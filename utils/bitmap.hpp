@@ -1,5 +1,10 @@
 #pragma once
 
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
 int count_bits(uint64_t bits) { return __builtin_popcountll(bits); }
 
 // 1000...0000
@@ -113,4 +118,139 @@ int find_the_largest_among_less_than(uint64_t bitmap, int pos) {
     if (smallers == 0)
         return -1;
     return find_the_largest(smallers);
-}
\ No newline at end of file
+}
+
+/*
+  Bitmap of N positions over (N + 63) / 64 words, in the bit order of the
+  single-word helpers above: position 0 is the most significant bit of
+  words_[0], position 64 the most significant bit of words_[1], and so on.
+
+  Every routine works a word at a time (popcnt, and tzcnt for
+  find_the_largest()) and skips the words that cannot hold the answer.
+  With N <= 64 the word index is the constant 0, so the routines compile to
+  the single-word helpers.
+
+  The *_atomic routines access the words with __atomic builtins, for
+  bitmaps that are updated concurrently; the others are plain accesses.
+*/
+template <size_t N> class Bitmap {
+  public:
+    static_assert(0 < N);
+    static constexpr size_t NUM_WORDS = (N + 63) / 64;
+
+    bool any() const {
+        for (size_t i = 0; i < NUM_WORDS; i++) {
+            if (words_[i])
+                return true;
+        }
+        return false;
+    }
+
+    bool any_atomic() const {
+        for (size_t i = 0; i < NUM_WORDS; i++) {
+            if (__atomic_load_n(&words_[i], __ATOMIC_SEQ_CST))
+                return true;
+        }
+        return false;
+    }
+
+    bool test(size_t pos) const {
+        assert(pos < N);
+        return is_bit_set_at_the_position(words_[word(pos)], pos % 64);
+    }
+
+    bool test_atomic(size_t pos) const {
+        assert(pos < N);
+        return is_bit_set_at_the_position(
+            __atomic_load_n(&words_[word(pos)], __ATOMIC_SEQ_CST), pos % 64);
+    }
+
+    void set(size_t pos) {
+        assert(pos < N);
+        words_[word(pos)] =
+            set_bit_at_the_given_location(words_[word(pos)], pos % 64);
+    }
+
+    void set_atomic(size_t pos) {
+        assert(pos < N);
+        __atomic_or_fetch(&words_[word(pos)],
+                          set_bit_at_the_given_location(pos % 64),
+                          __ATOMIC_SEQ_CST);
+    }
+
+    void clear() {
+        for (size_t i = 0; i < NUM_WORDS; i++) {
+            words_[i] = 0;
+        }
+    }
+
+    void clear_atomic() {
+        for (size_t i = 0; i < NUM_WORDS; i++) {
+            __atomic_store_n(&words_[i], 0, __ATOMIC_SEQ_CST);
+        }
+    }
+
+    int count() const {
+        int n = 0;
+        for (size_t i = 0; i < NUM_WORDS; i++) {
+            n += count_bits(words_[i]);
+        }
+        return n;
+    }
+
+    // the number of positions set before pos (prefix popcount)
+    int count_before(size_t pos) const {
+        assert(pos < N);
+        size_t w = word(pos);
+        int n = 0;
+        for (size_t i = 0; i < w; i++) {
+            n += count_bits(words_[i]);
+        }
+        uint64_t mask =
+            fill_the_left_side_until_before_the_given_position(pos % 64);
+        return n + count_bits(words_[w] & mask);
+    }
+
+    // -1 if no position is set
+    int find_largest() const { return find_largest_in_words_before(NUM_WORDS); }
+
+    // the largest position <= pos, -1 if none
+    int find_largest_among_or_less_than(size_t pos) const {
+        assert(pos < N);
+        size_t w = word(pos);
+        uint64_t head =
+            words_[w] & fill_the_left_side_until_the_given_position(pos % 64);
+        if (head)
+            return w * 64 + find_the_largest(head);
+        return find_largest_in_words_before(w);
+    }
+
+    // the largest position < pos, -1 if none
+    int find_largest_among_less_than(size_t pos) const {
+        if (pos == 0)
+            return -1;
+        return find_largest_among_or_less_than(pos - 1);
+    }
+
+    // {second largest, first largest} among the positions <= pos, -1 if
+    // there is none
+    std::pair<int, int> find_two_largest_among_or_less_than(size_t pos) const {
+        int first = find_largest_among_or_less_than(pos);
+        if (first == -1)
+            return {-1, -1};
+        return {find_largest_among_less_than(first), first};
+    }
+
+  private:
+    uint64_t words_[NUM_WORDS] = {};
+
+    static size_t word(size_t pos) { return NUM_WORDS == 1 ? 0 : pos / 64; }
+
+    int find_largest_in_words_before(size_t w) const {
+        while (0 < w--) {
+            if (words_[w])
+                return w * 64 + find_the_largest(words_[w]);
+        }
+        return -1;
+    }
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <dirent.h>     // opendir, readdir
 #include <errno.h>      // errno
 #include <sched.h>      // sched_setaffinity, getcpu
 #include <stdio.h>      // fflush
@@ -9,8 +10,14 @@
 #include <unistd.h>     // for gettid()
 
 #include <cassert>
+#include <cctype>
+#include <string>
 
-#define LOGICAL_CORE_SIZE 64
+// the largest number of cores (worker threads); set by CMake (MAX_CORES)
+#ifndef MAX_CORES
+#define MAX_CORES 64
+#endif
+#define LOGICAL_CORE_SIZE MAX_CORES
 
 class Numa {
  private:
@@ -59,4 +66,22 @@ class Numa {
     getCpu();
     assert(target_cpu == cpu_);
   };
+
+  // NUMA node of the cpu from sysfs (/sys/devices/system/cpu/cpuN/nodeM),
+  // 0 if it is unknown
+  static unsigned int node_of_cpu(unsigned int cpu) {
+    std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    DIR* dir = opendir(path.c_str());
+    if (!dir) return 0;
+    unsigned int node = 0;
+    while (struct dirent* entry = readdir(dir)) {
+      if (strncmp(entry->d_name, "node", 4) == 0 &&
+          isdigit(static_cast<unsigned char>(entry->d_name[4]))) {
+        node = static_cast<unsigned int>(atoi(entry->d_name + 4));
+        break;
+      }
+    }
+    closedir(dir);
+    return node;
+  }
 };
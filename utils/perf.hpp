@@ -38,18 +38,25 @@ class Perf {
         uint64_t member_;
     };
 
-    Perf(const int cpu, pid_t tid) {
+    // node writes: accesses (leader) and misses (member). Also used:
+    // PERF_COUNT_HW_CACHE_REFERENCES / PERF_COUNT_HW_CACHE_MISSES of
+    // PERF_TYPE_HARDWARE, 0x2d3 (mem_load_l3_miss_retired.remote_dram)
+    Perf(const int cpu, pid_t tid)
+        : Perf(cpu, tid, PERF_TYPE_HW_CACHE,
+               PERF_COUNT_HW_CACHE_NODE | (PERF_COUNT_HW_CACHE_OP_WRITE << 8) |
+                   (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16), // perf leader
+               PERF_COUNT_HW_CACHE_NODE | (PERF_COUNT_HW_CACHE_OP_WRITE << 8) |
+                   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)) {} // perf member
+
+    // counts the events (type, leader_config) and (type, member_config)
+    Perf(const int cpu, pid_t tid, uint32_t type, uint64_t leader_config,
+         uint64_t member_config) {
         struct perf_event_attr pe;
         memset(&pe, 0, sizeof(struct perf_event_attr));
         pe.size = sizeof(struct perf_event_attr);
 
-        pe.type = PERF_TYPE_HARDWARE;               // perf leader
-        pe.config = PERF_COUNT_HW_CACHE_REFERENCES; // perf leader
-        // pe.config = 0x2d3;  // mem_load_l3_miss_retired.remote_dram
-        pe.type = PERF_TYPE_HW_CACHE; // perf leader
-        pe.config = PERF_COUNT_HW_CACHE_NODE |
-                    (PERF_COUNT_HW_CACHE_OP_WRITE << 8) |
-                    (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16); // perf leader
+        pe.type = type;            // perf leader
+        pe.config = leader_config; // perf leader
 
         pe.read_format = PERF_FORMAT_GROUP;
         pe.disabled = 1;
@@ -64,12 +71,7 @@ class Perf {
             exit(EXIT_FAILURE);
         }
 
-        // pe.type = PERF_TYPE_HARDWARE;            // perf member
-        // pe.config = PERF_COUNT_HW_CACHE_MISSES;  // perf member
-        pe.type = PERF_TYPE_HW_CACHE; // perf member
-        pe.config = PERF_COUNT_HW_CACHE_NODE |
-                    (PERF_COUNT_HW_CACHE_OP_WRITE << 8) |
-                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16); // perf member
+        pe.config = member_config; // perf member
 
         fd_member_ = perf_event_open(&pe, tid, cpu, fd_leader_, 0);
         if (fd_member_ == -1) {
@@ -0,0 +1,250 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <type_traits>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/*
+  Sorted (ascending, by id) array of <id, value> pairs in structure-of-arrays
+  layout: the ids are contiguous, so a search only touches the id lines and
+  the value is loaded once the position is known.
+
+  The first INLINE elements live inside the object; the array spills to the
+  heap when it grows beyond them.
+
+  rank(key) = the number of ids less than key (= lower_bound). It is a
+  compare-and-movemask scan with AVX-512 or AVX2, and a binary search
+  otherwise. The implementation is selected at compile time (-march).
+
+  Id is int32_t/uint32_t/int64_t/uint64_t (or int); T must be trivially
+  copyable. The inline ids are aligned to IDS_ALIGN (a cache line by
+  default); a smaller one lets the array pack with the fields before it.
+*/
+template <typename Id, typename T, uint32_t INLINE, size_t IDS_ALIGN = 64>
+class SmallSortedArray {
+    static_assert(std::is_integral_v<Id> &&
+                      (sizeof(Id) == 4 || sizeof(Id) == 8),
+                  "Id must be a 32 or 64 bit integer");
+    static_assert(std::is_trivially_copyable_v<T>);
+    static_assert(0 < INLINE);
+
+  public:
+    SmallSortedArray() = default;
+    SmallSortedArray(const SmallSortedArray &) = delete;
+    SmallSortedArray &operator=(const SmallSortedArray &) = delete;
+
+    ~SmallSortedArray() {
+        if (!is_inline()) {
+            std::free(ids_);
+            std::free(values_);
+        }
+    }
+
+    uint32_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    Id id_at(uint32_t i) const {
+        assert(i < size_);
+        return ids_[i];
+    }
+    T &value_at(uint32_t i) {
+        assert(i < size_);
+        return values_[i];
+    }
+    Id back_id() const { return id_at(size_ - 1); }
+    T &back_value() { return value_at(size_ - 1); }
+
+    // number of ids < key
+    uint32_t rank(Id key) const { return count_less(ids_, size_, key); }
+
+    // number of ids <= key
+    uint32_t rank_inclusive(Id key) const {
+        if (key == std::numeric_limits<Id>::max())
+            return size_;
+        return rank(key + 1);
+    }
+
+    bool contains(Id id) const {
+        uint32_t pos = rank(id);
+        return pos < size_ && ids_[pos] == id;
+    }
+
+    // after the existing elements with the same id
+    void insert(Id id, T value) {
+        uint32_t pos = rank_inclusive(id);
+        if (size_ == capacity_)
+            grow();
+        uint32_t n = size_ - pos;
+        std::memmove(&ids_[pos + 1], &ids_[pos], n * sizeof(Id));
+        std::memmove(&values_[pos + 1], &values_[pos], n * sizeof(T));
+        ids_[pos] = id;
+        values_[pos] = value;
+        size_++;
+    }
+
+    // inserts the <id, value> pairs (first, second) of [first, last), in
+    // ascending order of id, as insert() would: one linear merge from the
+    // back instead of a search and a shift per pair
+    template <typename It> void merge(It first, It last) {
+        uint32_t n = static_cast<uint32_t>(last - first);
+        if (n == 0)
+            return;
+        while (capacity_ < size_ + n)
+            grow();
+        uint32_t i = size_; // the existing elements not moved yet: [0, i)
+        uint32_t pos = size_ + n;
+        while (first != last) {
+            const auto &pair = *(last - 1);
+            pos--;
+            if (0 < i && pair.first < ids_[i - 1]) {
+                i--;
+                ids_[pos] = ids_[i];
+                values_[pos] = values_[i];
+            } else { // after the existing elements with the same id
+                ids_[pos] = pair.first;
+                values_[pos] = pair.second;
+                --last;
+            }
+        }
+        size_ += n;
+    }
+
+    // remove the first n elements
+    void erase_front(uint32_t n) {
+        assert(n <= size_);
+        if (n == 0)
+            return;
+        uint32_t rest = size_ - n;
+        std::memmove(&ids_[0], &ids_[n], rest * sizeof(Id));
+        std::memmove(&values_[0], &values_[n], rest * sizeof(T));
+        size_ = rest;
+    }
+
+    void pop_back() {
+        assert(!empty());
+        size_--;
+    }
+
+    void clear() { size_ = 0; }
+
+  private:
+    Id *ids_ = inline_ids_;
+    T *values_ = inline_values_;
+    uint32_t size_ = 0;
+    uint32_t capacity_ = INLINE;
+    alignas(IDS_ALIGN) Id inline_ids_[INLINE];
+    T inline_values_[INLINE];
+
+    bool is_inline() const { return ids_ == inline_ids_; }
+
+    void grow() {
+        uint32_t capacity = capacity_ * 2;
+        Id *ids = static_cast<Id *>(std::aligned_alloc(
+            64, round_up_to_line(capacity * sizeof(Id))));
+        T *values = static_cast<T *>(std::malloc(capacity * sizeof(T)));
+        if (!ids || !values)
+            throw std::bad_alloc();
+        std::memcpy(ids, ids_, size_ * sizeof(Id));
+        std::memcpy(values, values_, size_ * sizeof(T));
+        if (!is_inline()) {
+            std::free(ids_);
+            std::free(values_);
+        }
+        ids_ = ids;
+        values_ = values;
+        capacity_ = capacity;
+    }
+
+    static size_t round_up_to_line(size_t n) { return (n + 63) & ~size_t(63); }
+
+    // ids[0, n) is sorted
+    static uint32_t count_less(const Id *ids, uint32_t n, Id key) {
+#if defined(__AVX512F__)
+        uint32_t cnt = 0;
+        uint32_t i = 0;
+        if constexpr (sizeof(Id) == 4) {
+            const __m512i k = _mm512_set1_epi32(static_cast<int32_t>(key));
+            for (; i < n; i += 16) {
+                __mmask16 load = (n - i < 16)
+                                     ? static_cast<__mmask16>((1u << (n - i)) - 1)
+                                     : static_cast<__mmask16>(0xFFFF);
+                __m512i v = _mm512_maskz_loadu_epi32(load, ids + i);
+                __mmask16 lt = std::is_signed_v<Id>
+                                   ? _mm512_mask_cmplt_epi32_mask(load, v, k)
+                                   : _mm512_mask_cmplt_epu32_mask(load, v, k);
+                cnt += __builtin_popcount(lt);
+            }
+        } else {
+            const __m512i k = _mm512_set1_epi64(static_cast<int64_t>(key));
+            for (; i < n; i += 8) {
+                __mmask8 load = (n - i < 8)
+                                    ? static_cast<__mmask8>((1u << (n - i)) - 1)
+                                    : static_cast<__mmask8>(0xFF);
+                __m512i v = _mm512_maskz_loadu_epi64(load, ids + i);
+                __mmask8 lt = std::is_signed_v<Id>
+                                  ? _mm512_mask_cmplt_epi64_mask(load, v, k)
+                                  : _mm512_mask_cmplt_epu64_mask(load, v, k);
+                cnt += __builtin_popcount(lt);
+            }
+        }
+        return cnt;
+#elif defined(__AVX2__)
+        uint32_t cnt = 0;
+        uint32_t i = 0;
+        if constexpr (sizeof(Id) == 4) {
+            // AVX2 only has signed compares: flip the sign bit of unsigned ids
+            const __m256i flip = _mm256_set1_epi32(
+                std::is_signed_v<Id> ? 0 : static_cast<int32_t>(0x80000000u));
+            const __m256i k = _mm256_xor_si256(
+                _mm256_set1_epi32(static_cast<int32_t>(key)), flip);
+            for (; i + 8 <= n; i += 8) {
+                __m256i v = _mm256_xor_si256(
+                    _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i *>(ids + i)),
+                    flip);
+                __m256i lt = _mm256_cmpgt_epi32(k, v);
+                cnt += __builtin_popcount(
+                    _mm256_movemask_ps(_mm256_castsi256_ps(lt)));
+            }
+        } else {
+            const __m256i flip = _mm256_set1_epi64x(
+                std::is_signed_v<Id> ? 0 : static_cast<int64_t>(1ULL << 63));
+            const __m256i k = _mm256_xor_si256(
+                _mm256_set1_epi64x(static_cast<int64_t>(key)), flip);
+            for (; i + 4 <= n; i += 4) {
+                __m256i v = _mm256_xor_si256(
+                    _mm256_loadu_si256(
+                        reinterpret_cast<const __m256i *>(ids + i)),
+                    flip);
+                __m256i lt = _mm256_cmpgt_epi64(k, v);
+                cnt += __builtin_popcount(
+                    _mm256_movemask_pd(_mm256_castsi256_pd(lt)));
+            }
+        }
+        for (; i < n; i++) {
+            cnt += ids[i] < key;
+        }
+        return cnt;
+#else
+        // binary search (lower_bound)
+        uint32_t lo = 0, hi = n;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (ids[mid] < key) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo;
+#endif
+    }
+};